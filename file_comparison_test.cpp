@@ -10,13 +10,21 @@ public:
     static std::string test_suite;
 protected:
     static constexpr int NUM_PLAYERS = 6;
-    std::array<std::vector<std::string>, NUM_PLAYERS> expected_lines;
-    std::array<std::vector<std::string>, NUM_PLAYERS> actual_lines;
+    static constexpr int NUM_SPECTATORS = 2;
+    // the players' logs, then the spectators'
+    static constexpr int NUM_LOGS = NUM_PLAYERS + NUM_SPECTATORS;
+    std::array<std::vector<std::string>, NUM_LOGS> expected_lines;
+    std::array<std::vector<std::string>, NUM_LOGS> actual_lines;
+
+    static std::string log_name(int i) {
+        if (i < NUM_PLAYERS) return "player" + std::to_string(i);
+        return "spectator" + std::to_string(i - NUM_PLAYERS);
+    }
 
     void SetUp() override {
         // Read all expected files
-        for (int i = 0; i < NUM_PLAYERS; ++i) {
-            std::string expected_path = "scripts/tests/" + test_suite + "/expected/player" + std::to_string(i) + ".logs";
+        for (int i = 0; i < NUM_LOGS; ++i) {
+            std::string expected_path = "scripts/tests/" + test_suite + "/expected/" + log_name(i) + ".logs";
             std::ifstream expected_file(expected_path);
             std::string line;
             while (std::getline(expected_file, line)) {
@@ -26,8 +34,8 @@ protected:
         }
 
         // Read all actual files
-        for (int i = 0; i < NUM_PLAYERS; ++i) {
-            std::string actual_path = "logs/player" + std::to_string(i) + ".logs";
+        for (int i = 0; i < NUM_LOGS; ++i) {
+            std::string actual_path = "logs/" + log_name(i) + ".logs";
             std::ifstream actual_file(actual_path);
             std::string line;
             while (std::getline(actual_file, line)) {
@@ -43,21 +51,21 @@ std::string FileComparisonTest::test_suite = "test1";
 
 // Test that both files have the same number of lines for each player
 TEST_F(FileComparisonTest, SameNumberOfLines) {
-    for (int i = 0; i < NUM_PLAYERS; ++i) {
+    for (int i = 0; i < NUM_LOGS; ++i) {
         EXPECT_EQ(expected_lines[i].size(), actual_lines[i].size()) 
-            << "Files for player " << i << " have different number of lines in test suite " << test_suite;
+            << "Files for " << log_name(i) << " have different number of lines in test suite " << test_suite;
     }
 }
 
-// Generate individual test cases for each line of each player
+// Generate individual test cases for each line of each log
 TEST_F(FileComparisonTest, CompareLines) {
-    for (int player = 0; player < NUM_PLAYERS; ++player) {
+    for (int file = 0; file < NUM_LOGS; ++file) {
         // Use the smaller size to avoid out of bounds access
-        size_t num_lines = std::min(expected_lines[player].size(), actual_lines[player].size());
+        size_t num_lines = std::min(expected_lines[file].size(), actual_lines[file].size());
         
         for (size_t i = 0; i < num_lines; ++i) {
-            EXPECT_EQ(expected_lines[player][i], actual_lines[player][i]) 
-                << "Line " << i + 1 << " differs between files for player " << player 
+            EXPECT_EQ(expected_lines[file][i], actual_lines[file][i]) 
+                << "Line " << i + 1 << " differs between files for " << log_name(file) 
                 << " in test suite " << test_suite;
         }
     }
@@ -0,0 +1,285 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "timer_wheel.h"
+#include "shm_ring.h"
+
+/**
+ * non-blocking event loop for the server
+ *
+ * every socket is owned by the loop. bytes read from a connection are appended
+ * to its input buffer and handed to on_data, which consumes whole packets and
+ * leaves the rest for later. writes are queued on the connection and flushed
+ * once per loop iteration, so everything a table sends in one tick goes out in
+ * one send per connection. nothing ever blocks on a single client: an idle or
+ * dead connection costs nothing until it becomes readable again.
+ *
+ * there are two backends behind the same interface:
+ *  - epoll: a readiness loop doing one recv()/send() system call per connection.
+ *  - io_uring: a receive is kept posted on every connection, and the sends of
+ *    a whole iteration are queued and submitted together with the wait for the
+ *    next completions, in a single io_uring_enter(). connections come from a
+ *    fixed pool that is registered with the ring as one buffer, and their
+ *    sockets sit in the ring's fixed file table, so the kernel neither maps
+ *    pages nor looks up files per request. if the pool cannot be pinned the
+ *    ring falls back to plain recv/send requests.
+ *
+ * output is a fixed size ring per connection, so a connection never holds
+ * more than CONN_BUFFER_SIZE bytes of it. once more than CONN_WBUF_HIGH bytes
+ * are waiting the connection is congested, and when it has drained below
+ * CONN_WBUF_LOW again on_drain is called. a client that lets the ring fill up
+ * completely is closed rather than sent a stream with a hole in it.
+ *
+ * each loop also owns a timer wheel ticking in milliseconds of loop_now().
+ * the loop never sleeps past its next timer, and fires due timers before
+ * flushing, so whatever they queue goes out in the same iteration.
+ *
+ * a connection can be switched to a shared memory channel (see shm_ring.h).
+ * its input is then taken from the channel and its output written to it, and
+ * the socket only carries doorbells. while the loop is busy it checks the
+ * channels of all such connections each iteration, and only before it goes to
+ * sleep does it park them, so that their clients ring.
+ *
+ * output meant for many connections alike can be queued by reference instead
+ * of copied: a shared_frame_t is encoded once and each connection it is
+ * written to keeps a reference until it has sent it. a connection queues at
+ * most CONN_FRAMES of them, and one that lets that many pile up is closed.
+ */
+
+#define CONN_BUFFER_SIZE 4096
+#define CONN_WBUF_HIGH (CONN_BUFFER_SIZE * 3 / 4)   // congested above this much unsent output
+#define CONN_WBUF_LOW (CONN_BUFFER_SIZE / 4)        // and no longer once it is back below this
+#define LOOP_URING_CONNS 4096           // size of the connection pool of an io_uring loop
+#define CONN_FRAMES 64                  // shared frames a connection can have queued
+
+typedef enum {
+    LOOP_EPOLL,
+    LOOP_IO_URING
+} loop_backend_t;
+
+typedef struct conn conn_t;
+typedef struct event_loop event_loop_t;
+
+// only ever referenced from the thread of the loop it is written on, the count is not atomic
+typedef struct {
+    int refs;
+    size_t len;
+    unsigned char data[];
+} shared_frame_t;
+
+typedef enum {
+    CONN_STREAM,                        // a client connection carrying packets
+    CONN_LISTENER,                      // accepts new connections
+    CONN_NOTIFY                         // an eventfd other threads use to wake the loop
+} conn_kind_t;
+
+struct conn {
+    int fd;
+    conn_kind_t kind;
+    int tag;                            // free for the owner, e.g. the seat a listener serves
+    uint32_t events;                    // epoll events the fd is registered for
+    int eof;                            // the peer hung up, rbuf holds whatever it sent before
+    int closing;                        // close as soon as wbuf has drained
+    void *owner;                        // whoever the connection belongs to (e.g. its table)
+    int seat;                           // the owner's index for it
+    conn_t *next_dirty;                 // connections with output waiting for the next flush
+    int dirty;
+    conn_t *next_closed;                // closed this iteration, freed at its end
+    int inflight;                       // io_uring requests that still point at the connection
+    int buried;                         // closed, freed when the last request completes
+    int receiving, sending;             // a receive / send request is posted
+    size_t recv_off;                    // where the posted receive writes in rbuf
+    size_t rlen;                        // bytes waiting in rbuf
+    size_t woff, wlen;                  // wlen unsent bytes start at wbuf[woff], wrapping around
+    int congested;                      // more than CONN_WBUF_HIGH bytes are waiting to be sent
+    shm_channel_t *shm;                 // the client talks through shared memory, NULL if not
+    conn_t *next_shm, *prev_shm;        // in the loop's list of shared memory connections
+    conn_t *next_peer, *prev_peer;      // free for the owner, e.g. to list its spectators
+    shared_frame_t *frames[CONN_FRAMES];    // output queued by reference, a ring sent after wbuf
+    int frame_head, frame_cnt;
+    size_t frame_off;                   // how much of the first frame has been sent
+    unsigned char bell[16];             // where doorbells are received
+    unsigned char rbuf[CONN_BUFFER_SIZE];
+    unsigned char wbuf[CONN_BUFFER_SIZE];
+};
+
+typedef struct {
+    void (*on_accept)(event_loop_t *loop, conn_t *listener, conn_t *conn);  // a new connection
+    void (*on_data)(event_loop_t *loop, conn_t *conn);                      // rbuf grew or eof was set
+    void (*on_close)(event_loop_t *loop, conn_t *conn);                     // conn is about to be freed
+    void (*on_notify)(event_loop_t *loop, conn_t *notify);                  // the eventfd was signalled
+    void (*on_drain)(event_loop_t *loop, conn_t *conn);                     // conn is no longer congested
+} loop_ops_t;
+
+typedef struct uring uring_t;
+
+struct event_loop {
+    loop_backend_t backend;
+    int epfd;
+    uring_t *uring;
+    int fixed_files;                    // sockets are in the ring's fixed file table
+    int fixed_buffers;                  // the connection pool is a registered buffer
+    conn_t *pool;                       // LOOP_URING_CONNS connections for io_uring
+    conn_t *free_conns;
+    const loop_ops_t *ops;
+    void *ctx;                          // for the callbacks
+    conn_t *dirty;
+    conn_t *graveyard;                  // closed during this iteration, freed at its end
+    conn_t *shm_conns;
+    int num_conns;                      // open connections, listeners excluded
+    int num_closing;                    // connections closing once their output is sent
+    uint64_t now_ms;                    // monotonic clock, read once per iteration
+    timer_wheel_t timers;
+};
+
+/**
+ * @brief creates the loop
+ *
+ * @param backend the backend to use, io_uring falls back to epoll if the
+ *        kernel does not support it. loop->backend says which one was picked
+ * @return 0 on success, -1 on failure
+ */
+int loop_init(event_loop_t *loop, const loop_ops_t *ops, void *ctx, loop_backend_t backend);
+
+/**
+ * @brief adds a listening socket
+ *
+ * @param tag copied into the listener's tag, connections it accepts can read it
+ * @return the listener, NULL on failure
+ */
+conn_t *loop_listen(event_loop_t *loop, int fd, int tag);
+
+/**
+ * @brief adds an eventfd that calls on_notify when another thread signals it
+ *
+ * @return the notifier, NULL on failure
+ */
+conn_t *loop_notifier(event_loop_t *loop);
+
+/**
+ * @brief wakes the loop owning a notifier, safe to call from any thread
+ */
+void loop_notify(conn_t *notify);
+
+/**
+ * @brief takes a connection's socket out of the loop without closing it
+ *
+ * the connection is freed at the end of the iteration, its buffered input is
+ * lost unless the caller copied it first. a shared memory channel stays mapped,
+ * the caller takes it over from c->shm. used to move a client to another loop.
+ *
+ * @return the socket
+ */
+int loop_release(event_loop_t *loop, conn_t *c);
+
+/**
+ * @brief adds an already connected socket, as if it had been accepted here
+ *
+ * @param buf bytes the client already sent, they go in the input buffer
+ * @param len how many, at most CONN_BUFFER_SIZE
+ * @param shm the connection's shared memory channel, NULL if it has none
+ * @return the connection, NULL on failure (the socket is closed and the
+ *         channel unmapped)
+ */
+conn_t *loop_adopt(event_loop_t *loop, int fd, const void *buf, size_t len, shm_channel_t *shm);
+
+/**
+ * @brief moves a connection's traffic to a shared memory channel
+ *
+ * the loop owns the channel from now on. anything the socket carries after
+ * the switch is a doorbell, so the caller consumes whatever rbuf holds of it
+ * first. the client is rung once the channel is mapped and only then starts
+ * writing to it, its input goes to on_data like any other.
+ */
+void conn_attach_shm(event_loop_t *loop, conn_t *c, shm_channel_t *shm);
+
+/**
+ * @brief waits for events and handles them, then flushes every pending write
+ *
+ * @param timeout_ms how long to wait for an event, -1 for no limit. the wait
+ *        is cut short when a timer is due first
+ */
+void loop_run_once(event_loop_t *loop, int timeout_ms);
+
+/**
+ * @brief the loop's clock in milliseconds, as of the start of this iteration
+ */
+static inline uint64_t loop_now(const event_loop_t *loop)
+{
+    return loop->now_ms;
+}
+
+/**
+ * @brief arms a timer on the loop's wheel to fire after ms milliseconds
+ */
+void loop_timer(event_loop_t *loop, tw_timer_t *t, uint64_t ms, tw_callback_t fn, void *arg);
+
+/**
+ * @brief disarms a timer of the loop
+ */
+void loop_cancel_timer(event_loop_t *loop, tw_timer_t *t);
+
+/**
+ * @brief closes every connection and listener and the epoll instance
+ */
+void loop_fini(event_loop_t *loop);
+
+/**
+ * @brief queues bytes to be sent at the end of this loop iteration
+ *
+ * @return 0 on success, -1 if the connection is closed or its buffer is full,
+ *         in which case it is closed
+ */
+int conn_write(event_loop_t *loop, conn_t *c, const void *buf, size_t len);
+
+/**
+ * @brief queues the segments of one message, all of them or none
+ *
+ * @return 0 on success, -1 if the connection is closed or its buffer is full,
+ *         in which case it is closed
+ */
+int conn_writev(event_loop_t *loop, conn_t *c, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief copies bytes into a new shared frame
+ *
+ * @return the frame with a single reference, the caller's, NULL on failure
+ */
+shared_frame_t *frame_new(const void *buf, size_t len);
+
+/**
+ * @brief drops a reference to a frame, freeing it with the last one
+ */
+void frame_put(shared_frame_t *f);
+
+/**
+ * @brief queues a shared frame to be sent at the end of this loop iteration
+ *
+ * the connection takes a reference of its own. a connection gets its output
+ * either this way or through conn_write, not both.
+ *
+ * @return 0 on success, -1 if the connection is closed or already has
+ *         CONN_FRAMES frames queued, in which case it is closed
+ */
+int conn_write_shared(event_loop_t *loop, conn_t *c, shared_frame_t *f);
+
+/**
+ * @brief removes the first n bytes of the input buffer
+ */
+void conn_consume(event_loop_t *loop, conn_t *c, size_t n);
+
+/**
+ * @brief closes a connection once its queued output has been sent
+ */
+void conn_close(event_loop_t *loop, conn_t *c);
+
+/**
+ * @brief closes a listener straight away
+ */
+void loop_unlisten(event_loop_t *loop, conn_t *listener);
+
+#endif
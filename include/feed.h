@@ -0,0 +1,88 @@
+#ifndef FEED_H
+#define FEED_H
+
+#include "poker_client.h"
+#include "event_loop.h"
+
+/**
+ * a table's spectator feed
+ *
+ * spectators follow a table without a seat and never send anything. they get
+ * the public part of every INFO, with no hole cards, and the same END and
+ * HALT the seats get, so cards are only shown at showdown.
+ *
+ * each update is encoded once, into a shared frame that every spectator's
+ * connection queues by reference (see event_loop.h), so a table with
+ * thousands of them costs one encoding per update and a pointer per viewer.
+ * the first INFO of each hand is a full one and the rest are deltas.
+ *
+ * with a delay the frames wait delay_ms before they are let out, and the
+ * feed keeps the public state as of the last frame let out. a spectator who
+ * comes in during a hand is sent that in full, never anything the delay still
+ * holds back. one that stops reading is closed once CONN_FRAMES frames are
+ * waiting for it.
+ */
+
+typedef struct feed_item feed_item_t;
+typedef struct feed feed_t;
+
+struct feed {
+    event_loop_t *loop;
+    int max_watchers;
+    int delay_ms;
+    conn_t *watchers;                   // linked through next_peer and prev_peer
+    int num_watchers;
+    info_packet_t encoded;              // the last INFO put in the feed, the base of the next delta
+    int hand_start;                     // the next INFO starts a hand and goes out in full
+    info_packet_t shown;                // the last INFO let out
+    int in_hand;                        // shown is of a hand that is still being played
+    feed_item_t *head, *tail;           // frames waiting out the delay, oldest first
+    tw_timer_t timer;                   // runs while frames wait
+    void (*on_closed)(void *arg);       // once the HALT has been let out
+    void *closed_arg;
+};
+
+/**
+ * @brief sets up an empty feed
+ *
+ * @param max_watchers how many spectators it takes, 0 for none
+ * @param delay_ms how long every frame is held back, 0 to let it out at once
+ */
+void feed_init(feed_t *f, event_loop_t *loop, int max_watchers, int delay_ms);
+
+/**
+ * @brief adds a spectator, who is sent the hand in progress if there is one
+ *
+ * @return 0 on success, -1 if the feed is full
+ */
+int feed_add(feed_t *f, conn_t *c);
+
+/**
+ * @brief forgets a spectator whose connection is being closed
+ */
+void feed_remove(feed_t *f, conn_t *c);
+
+/**
+ * @brief throws away whatever a spectator sent, and closes it once it hangs up
+ */
+void feed_heard(feed_t *f, conn_t *c);
+
+/**
+ * @brief puts an INFO in the feed, its hole cards are left out
+ */
+void feed_info(feed_t *f, const info_packet_t *info);
+
+/**
+ * @brief puts an encoded END in the feed, after which a new hand starts
+ */
+void feed_end(feed_t *f, const uint8_t *frame, size_t len);
+
+/**
+ * @brief puts an encoded HALT in the feed, the last frame it takes
+ *
+ * every spectator is closed once it goes out, then on_closed(arg) is called.
+ * without a delay that happens before this returns.
+ */
+void feed_halt(feed_t *f, const uint8_t *frame, size_t len, void (*on_closed)(void *arg), void *arg);
+
+#endif
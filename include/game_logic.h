@@ -3,6 +3,8 @@
 
 #include "poker_client.h"  // for card_t, player_id_t
 #include "macros.h"        // for constants like MAX_PLAYERS
+#include "hand_eval.h"     // for hand_state_t
+#include "rng.h"           // for rng_t
 
 #define MAX_COMMUNITY_CARDS 5
 #define HAND_SIZE 2
@@ -27,7 +29,7 @@ typedef enum {
 typedef struct {
     card_t player_hands[MAX_PLAYERS][HAND_SIZE];   // each player’s 2 cards
     card_t community_cards[MAX_COMMUNITY_CARDS];   // shared cards on table
-    card_t deck[DECK_SIZE];                        // main deck
+    card_t deck[DECK_SIZE];                        // main deck, deck[0..next_card) already dealt
     int next_card;                                 // index of the next card to be drawn
     int player_stacks[MAX_PLAYERS];                // how many chips each player has
     int current_bets[MAX_PLAYERS];                 // amount bet this round
@@ -39,22 +41,30 @@ typedef struct {
     round_stage_t round_stage;                     // init/preflop/flop/turn/river/showdown
     int num_players;                               // total players in game
     int sockets[MAX_PLAYERS];                      // sockets for each player
+    hand_state_t board_state;                      // community cards dealt so far
+    hand_state_t hand_states[MAX_PLAYERS];         // board plus each player's hole cards
+    int hand_scores[MAX_PLAYERS];                  // score of each hand with the current board
+    int contributions[MAX_PLAYERS];                // chips each player put in the pot this hand
+    pot_result_t pots[MAX_POTS];                   // how the pot was paid out, main pot first
+    int num_pots;                                  // pots paid out at the end of the hand
+    uint64_t seed;                                 // server seed every hand is shuffled from
+    int table_id;                                  // picks this table's random streams
+    int hand_number;                               // hands started at this table
+    rng_t rng;                                     // random stream of the current hand
 } game_state_t;
 
 void init_game_state(game_state_t *game, int starting_stack, int random_seed);
 void reset_game_state(game_state_t *game);
 void print_game_state(game_state_t *game); // for debugging
-void init_deck(card_t deck[DECK_SIZE], int seed); 
-void shuffle_deck(card_t deck[DECK_SIZE]);
+void init_deck(card_t deck[DECK_SIZE]);
+void shuffle_deck(card_t deck[DECK_SIZE], rng_t *rng);
+void seed_hand(game_state_t *game);
+card_t draw_card(game_state_t *game);
 int check_betting_end(game_state_t *game);
-int find_winner(game_state_t *game);
-int evaluate_hand(game_state_t *game, player_id_t pid);
+int settle_pots(game_state_t *game);
+void reset_hand_states(game_state_t *game);
 
-void server_join(game_state_t *game);
-int server_ready(game_state_t *game);
 void server_deal(game_state_t *game);
-int server_bet(game_state_t *game);
 void server_community(game_state_t *game);
-void server_end(game_state_t *game);
 
 #endif
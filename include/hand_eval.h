@@ -0,0 +1,146 @@
+#ifndef HAND_EVAL_H
+#define HAND_EVAL_H
+
+#include <stdint.h>
+
+#include "poker_client.h"  // for card_t
+
+/**
+ * hand scores are packed as (category << 20) | detail, where the detail holds
+ * the deciding ranks four bits at a time. a larger score is always a stronger
+ * hand, so two scores can be compared directly.
+ */
+
+#define HAND_CATEGORY_SHIFT 20
+#define HAND_CATEGORY(score) ((score) >> HAND_CATEGORY_SHIFT)
+
+#define MAX_EVAL_CARDS 7
+#define BOARD_CARDS 5
+#define HOLE_CARDS 2
+
+/**
+ * a set of cards packed into one 64 bit word: four 13 bit lanes, one per suite,
+ * with bit RANK(card) of lane SUITE(card) set for each card in the set.
+ *
+ * combining sets is a bitwise or, e.g. board | CARD_BIT(hole[0]) | CARD_BIT(hole[1])
+ */
+typedef uint64_t cardset_t;
+
+#define SUITE_LANE_BITS 13
+#define SUITE_LANE_MASK ((1 << SUITE_LANE_BITS) - 1)
+
+#define CARD_BIT(card) ((cardset_t)1 << (SUITE(card) * SUITE_LANE_BITS + RANK(card)))
+#define SUITE_LANE(set, suite) ((int)((set) >> ((suite) * SUITE_LANE_BITS)) & SUITE_LANE_MASK)
+
+/**
+ * a hand that cards are added to one at a time (e.g. as streets are dealt).
+ * it keeps the rank and suite histograms that hand_eval would otherwise have to
+ * rebuild, so scoring it skips the pass over the cards.
+ */
+typedef struct {
+    cardset_t cards;                   // every card added so far
+    unsigned char rank_count[13];      // cards of each rank
+    unsigned char suite_count[4];      // cards of each suite
+    int count;                         // total cards
+} hand_state_t;
+
+typedef enum {
+    HIGH_CARD       = 0,
+    ONE_PAIR        = 1,
+    TWO_PAIR        = 2,
+    THREE_OF_A_KIND = 3,
+    STRAIGHT        = 4,
+    FLUSH           = 5,
+    FULL_HOUSE      = 6,
+    FOUR_OF_A_KIND  = 7,
+    STRAIGHT_FLUSH  = 8
+} hand_category_t;
+
+/**
+ * @brief builds the lookup tables used by hand_eval
+ *
+ * safe to call more than once. must be called before the first evaluation
+ * (and before any threads start evaluating hands).
+ */
+void hand_eval_init(void);
+
+/**
+ * @brief scores the best hand that can be made from a set of cards
+ *
+ * @param cards the cards to evaluate (no duplicates, NOCARD not allowed)
+ * @param count how many cards there are, at most MAX_EVAL_CARDS
+ * @return the packed score of the hand
+ */
+int hand_eval(const card_t *cards, int count);
+
+/**
+ * @brief empties a hand state
+ */
+void hand_state_clear(hand_state_t *st);
+
+/**
+ * @brief adds a card to a hand state
+ *
+ * @param st the hand to add to, holding fewer than MAX_EVAL_CARDS cards
+ * @param card the card to add (not NOCARD, and not already in the hand)
+ */
+void hand_state_add(hand_state_t *st, card_t card);
+
+/**
+ * @brief scores a hand state, giving the same score as hand_eval
+ *
+ * @param st the hand to score
+ * @return the packed score of the hand
+ */
+int hand_eval_state(const hand_state_t *st);
+
+/**
+ * @brief builds a card set from a list of cards
+ *
+ * @param cards the cards to add, NOCARD entries are skipped
+ * @param count the number of entries in cards
+ * @return the set holding every card
+ */
+cardset_t cardset_of(const card_t *cards, int count);
+
+/**
+ * @brief scores the best hand in a card set without branching on its contents
+ *
+ * gives the same score as hand_eval for the same cards
+ *
+ * @param set the cards to evaluate, at most MAX_EVAL_CARDS of them
+ * @return the packed score of the hand
+ */
+int hand_eval_set(cardset_t set);
+
+/**
+ * @brief scores many hands that share the same board in one call
+ *
+ * uses AVX2 or SSE4.1 kernels when the cpu has them (checked by hand_eval_init)
+ * and a scalar loop otherwise. every kernel gives the same scores as hand_eval.
+ *
+ * @param board the community cards, NOCARD for cards not dealt yet
+ * @param holes the hole cards of each hand
+ * @param n the number of hands
+ * @param scores where the packed score of each hand is written (n entries)
+ */
+void evaluate_hands_batch(const card_t board[BOARD_CARDS], const card_t holes[][HOLE_CARDS], int n, int *scores);
+
+/**
+ * @brief names the kernel evaluate_hands_batch is using
+ *
+ * @return "scalar", "sse4" or "avx2"
+ */
+const char *hand_eval_kernel(void);
+
+/**
+ * @brief makes evaluate_hands_batch use a given kernel (e.g. to benchmark each one)
+ *
+ * call after hand_eval_init, which would otherwise pick the kernel again
+ *
+ * @param name "scalar", "sse4" or "avx2"
+ * @return 0 on success, -1 if the kernel is unknown or the cpu lacks it
+ */
+int hand_eval_use_kernel(const char *name);
+
+#endif
@@ -5,6 +5,8 @@
 
 void log_init(const char *tag);
 void log_player_init(int num);
+void log_table_player_init(int table, int num); // same as log_player_init for table 0
+void log_table_spectator_init(int table, int num); // spectatorNUM.logs, prefixed like the above
 
 void log_info(const char *fmt_str, ...);
 void log_debug(const char *fmt_str, ...);
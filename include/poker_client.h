@@ -3,9 +3,18 @@
 
 #include "macros.h"
 #include "wchar.h"
+#include <stdint.h>
 
 #define MAX_PLAYERS 6
-#define MAX_CLIENT_PACKET_PARAMS 1
+#define MAX_CLIENT_PACKET_PARAMS 2
+
+// the server also listens on a unix domain socket, for clients on the same host
+#define SERVER_SOCKET_PATH "/tmp/poker_server.sock"
+#define SERVER_SOCKET_ENV "POKER_SERVER_SOCKET"
+#define SERVER_SHM_ENV "POKER_SERVER_SHM"
+
+// a JOIN for whichever seat is free, the server answers with the seat it picked
+#define ANY_SEAT -1
 
 // ---------------------------- utility functions ---------------------------- //
 
@@ -40,13 +49,98 @@ const wchar_t *fancy_card_name(card_t card);
 // ---------------------------- Underlying networking functions ---------------------------- //
 
 /**
- * @brief connect to the the server as a player
+ * @brief connect to the the server as a player at table 0
  * 
  * @param player_id the player to connect to server as
  * @return 0 on success, -1 otherwise
  */
 int connect_to_serv(player_id_t player_id);
 
+/**
+ * @brief connect to the the server as a player at one of its tables
+ * 
+ * @param table_id the table to sit at
+ * @param player_id the seat to take at that table
+ * @return 0 on success, -1 otherwise
+ */
+int connect_to_table(int table_id, player_id_t player_id);
+
+/**
+ * @brief connect to the server and take whichever seat is free at a table
+ *
+ * the server seats players at any time, between hands as well as before the
+ * first. a player that sits down during a hand is dealt in from the next one.
+ *
+ * @param table_id the table to sit at
+ * @return the seat the server gave us, -1 on failure (e.g. the table is full)
+ */
+int connect_to_any_seat(int table_id);
+
+/**
+ * @brief take our seat back on a new connection after the old one dropped
+ *
+ * the server keeps a dropped player's seat for a while (the turn timer acts for
+ * them meanwhile). if a hand is being played, the next packet is an INFO with
+ * all of it, whatever was missed.
+ *
+ * @return 0 on success, -1 if the seat was given up or the server is unreachable
+ */
+int reconnect_to_table();
+
+/**
+ * @brief take a seat back with a token from get_session, e.g. one a bot saved before it restarted
+ *
+ * the same as reconnect_to_table, for a seat the client does not hold a session for.
+ * the server refuses a token that is not the seat's.
+ *
+ * @return 0 on success, -1 if the server refused or is unreachable
+ */
+int resume_seat(int table_id, player_id_t seat, uint64_t token);
+
+/**
+ * @brief the seat we hold and the token that takes it back
+ *
+ * @return 0 on success, -1 if we hold no seat
+ */
+int get_session(int *table_id, player_id_t *seat, uint64_t *token);
+
+/**
+ * @brief connect to the server as a spectator of a table
+ *
+ * a spectator sends nothing and takes no seat. recv_packet() then returns the
+ * table's INFOs without hole cards, the END of each hand (which shows them)
+ * and finally HALT, possibly some time after the players saw them if the
+ * server delays its spectators. one who comes in during a hand is first sent
+ * an INFO with all of it.
+ *
+ * @param table_id the table to watch
+ * @return 0 on success, -1 otherwise (the server hangs up if the table takes no more spectators)
+ */
+int watch_table(int table_id);
+
+/**
+ * @brief connect through the server's unix domain socket instead of TCP
+ *
+ * skips the TCP stack for clients on the same host, the packets are the same.
+ * when never called, the path is taken from the SERVER_SOCKET_ENV environment
+ * variable, and TCP is used if that is not set either.
+ *
+ * @param path the socket path (e.g. SERVER_SOCKET_PATH), NULL for TCP
+ */
+void set_server_socket(const char *path);
+
+/**
+ * @brief carry the packets over shared memory rather than the socket
+ *
+ * for bots on the server's host: after connecting to the unix domain socket
+ * (SERVER_SOCKET_PATH unless another one was set), the client hands the
+ * server a shared memory channel and only uses the socket to wake it. when
+ * never called, it is enabled if the SERVER_SHM_ENV environment variable is set.
+ *
+ * @param enabled 1 to use shared memory, 0 for the socket alone
+ */
+void set_server_shm(int enabled);
+
 /**
  * @brief gracefully disconnect from the server
  *  
@@ -59,7 +153,7 @@ int disconnect_to_serv();
  */
 typedef enum client_packet_type
 {  
-    JOIN,       // join the server
+    JOIN,       // join the server, params[0] is the table and params[1] the seat (or ANY_SEAT)
     LEAVE,      // leave the server
     READY,      // say ready for the round
     RAISE,      // raise the bet
@@ -77,6 +171,10 @@ typedef struct client_packet
 /**
  * @brief sends a packet to the connected server, then waits for a response
  * 
+ * an INFO or END that arrives before the response is kept for recv_packet. the
+ * server refuses an action when it is not the player's turn, e.g. once the turn
+ * timer acted for them, and the packets it sent meanwhile are then waiting.
+ *
  * @param pkt the packet contents to send to the server
  * @return 0 on success (ACK response), -1 on failure
  */
@@ -110,6 +208,17 @@ typedef struct
     int player_status[MAX_PLAYERS]; //1 for in hand, 0 for folded, 2 for left
 } info_packet_t;
 
+#define MAX_POTS MAX_PLAYERS
+
+/**
+ * @brief one pot paid out at the end of a hand (the main pot or a side pot)
+ */
+typedef struct
+{
+    int amount; //chips in the pot
+    int winners; //bit p is set if player p won a share of the pot
+} pot_result_t;
+
 /**
  * @brief information about the packet that is send to the client after a hand
  */
@@ -117,11 +226,13 @@ typedef struct
 {
     card_t player_cards[MAX_PLAYERS][2];
     card_t community_cards[5];
-    int player_stacks[MAX_PLAYERS]; //Updated to add pot size to winner
+    int player_stacks[MAX_PLAYERS]; //Updated to add every pot won
     int pot_size;
     player_id_t dealer; //old dealer (from the finished hand)
-    player_id_t winner; //ignore chopped pots
+    player_id_t winner; //first winner of the main pot, see pots for every pot
     int player_status[MAX_PLAYERS]; //1 for in hand, 0 for folded, 2 for left
+    int num_pots; //main pot first, then each side pot
+    pot_result_t pots[MAX_POTS];
 } end_packet_t;
 
 /**
@@ -145,6 +256,13 @@ typedef struct server_packet
  */
 int recv_packet(server_packet_t *pkt);
 
+/**
+ * @brief checks if a packet has already arrived, e.g. one send_packet kept while it waited
+ *
+ * @return 1 if recv_packet will return without waiting, 0 otherwise
+ */
+int has_packet_waiting();
+
 // ---------------------------- poker operations ---------------------------- //
 
 typedef void(*info_packet_handler_t)(info_packet_t*);
@@ -0,0 +1,57 @@
+#ifndef POKER_EQUITY_H
+#define POKER_EQUITY_H
+
+#include <stdint.h>
+
+#include "poker_client.h"  // for card_t, MAX_PLAYERS
+#include "hand_eval.h"     // for BOARD_CARDS, HOLE_CARDS
+
+/**
+ * all-in equity of up to MAX_PLAYERS hands
+ *
+ * any card that is not known yet is NOCARD: undealt board cards, and both hole
+ * cards of an opponent whose hand is unknown (a random hand is dealt to them).
+ */
+typedef struct {
+    int num_players;
+    card_t holes[MAX_PLAYERS][HOLE_CARDS];
+    card_t board[BOARD_CARDS];
+} equity_query_t;
+
+typedef struct {
+    uint64_t runouts;                  // how many boards were evaluated
+    double win[MAX_PLAYERS];           // fraction of runouts won outright
+    double tie[MAX_PLAYERS];           // fraction of runouts split with someone
+    double equity[MAX_PLAYERS];        // expected share of the pot
+} equity_result_t;
+
+/**
+ * @brief estimates equity by sampling random runouts
+ *
+ * the runouts are split over `threads` threads, each drawing from its own
+ * random stream of `seed`, so the same arguments always give the same result.
+ *
+ * @param q the hands and board
+ * @param runouts how many runouts to sample in total
+ * @param threads worker threads to use, 0 for one per online cpu
+ * @param seed the seed of the random streams
+ * @param out where the result is written
+ * @return 0 on success, -1 if the query is invalid (duplicate cards, too many players...)
+ */
+int equity_monte_carlo(const equity_query_t *q, uint64_t runouts, int threads, uint64_t seed, equity_result_t *out);
+
+/**
+ * @brief computes equity exactly by walking every possible runout
+ *
+ * every hole card must be known. the runouts are split between threads by the
+ * first undealt board card, and each partial board is added to the hands once
+ * and shared by every runout that continues it.
+ *
+ * @param q the hands and board
+ * @param threads worker threads to use, 0 for one per online cpu
+ * @param out where the result is written (runouts is the number of boards)
+ * @return 0 on success, -1 if the query is invalid or has unknown hole cards
+ */
+int equity_exact(const equity_query_t *q, int threads, equity_result_t *out);
+
+#endif
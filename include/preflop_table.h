@@ -0,0 +1,68 @@
+#ifndef PREFLOP_TABLE_H
+#define PREFLOP_TABLE_H
+
+#include <stdint.h>
+
+#include "poker_client.h"  // for card_t
+
+/**
+ * precomputed preflop equity of every starting hand
+ *
+ * the 169 starting hand classes are laid out on a 13x13 grid of ranks: pairs on
+ * the diagonal, suited hands at [high][low] and offsuit hands at [low][high].
+ * each class stores its equity against 1 to PREFLOP_MAX_OPPONENTS random hands
+ * as a 16 bit fraction of 65535.
+ *
+ * the file is the preflop_table_t below, byte for byte in host byte order. it
+ * is built by `make gen.preflop` and mapped read-only, so opening it costs no
+ * parsing and every lookup is a single load.
+ */
+
+#define PREFLOP_MAGIC 0x51455250u  // "PREQ"
+#define PREFLOP_VERSION 1
+#define PREFLOP_CLASSES 169
+#define PREFLOP_MAX_OPPONENTS 5
+
+#define PREFLOP_TABLE_PATH "build/preflop.eq"
+#define PREFLOP_TABLE_ENV "POKER_PREFLOP_TABLE"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_classes;
+    uint16_t max_opponents;
+    uint16_t reserved;
+    uint32_t runouts;        // runouts sampled per entry
+    uint16_t equity[PREFLOP_CLASSES][PREFLOP_MAX_OPPONENTS];
+} preflop_table_t;
+
+/**
+ * @brief maps a preflop table file into memory
+ *
+ * @param path the file to open, NULL for $POKER_PREFLOP_TABLE or PREFLOP_TABLE_PATH
+ * @return the table, or NULL if it is missing or not a valid table
+ */
+const preflop_table_t *preflop_table_open(const char *path);
+
+/**
+ * @brief unmaps a table returned by preflop_table_open
+ */
+void preflop_table_close(const preflop_table_t *table);
+
+/**
+ * @brief the starting hand class (0 to 168) of two hole cards
+ */
+int preflop_class(card_t c0, card_t c1);
+
+/**
+ * @brief looks up the equity of two hole cards against random hands
+ *
+ * @param table the table to read
+ * @param c0 the first hole card
+ * @param c1 the second hole card
+ * @param opponents how many random hands, clamped to [1, PREFLOP_MAX_OPPONENTS]
+ * @return the equity as a fraction in [0, 1]
+ */
+double preflop_equity(const preflop_table_t *table, card_t c0, card_t c1, int opponents);
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "poker_client.h"
+
+/**
+ * wire format shared by the client and the server
+ *
+ * every packet travels as one frame:
+ *
+ *      | length (2, big endian) | version (1) | type (1) | payload |
+ *
+ * where length counts every byte after itself. a reader therefore knows from
+ * the first two bytes how much to wait for, and never acts on half a packet.
+ *
+ * payload fields are packed instead of copied from the structs: a card is one
+ * byte (0xff for NOCARD), the six player statuses share two bytes, and chip
+ * counts and other integers are varints (zigzag for the ones that can be
+ * negative). a frame with an unknown version is rejected.
+ *
+ * an INFO can also be sent as a delta against the previous INFO on the same
+ * connection: a bit mask of the fields that changed followed by just those
+ * fields. the decoder turns it back into a complete info_packet_t, so only
+ * the wire ever sees the difference.
+ *
+ * the hole cards are always the last two bytes of an INFO (and are left out
+ * of a delta when they did not change), so everything before them is the same
+ * for every seat. a broadcast encodes that part once and gives each seat just
+ * its own header and hole cards around it.
+ */
+
+#define PROTO_VERSION 1
+#define PROTO_LENGTH_SIZE 2
+#define PROTO_HEADER_SIZE 4
+#define PROTO_MAX_FRAME 256             // larger than the largest packet
+
+// wire only packet types: INFO_DELTA is decoded as INFO. the others have no
+// packet at all: ATTACH names a shared memory channel (see shm_ring.h), SEATED
+// tells the seat a JOIN for ANY_SEAT was given, SESSION hands a seated player
+// the token that RESUME names when it reconnects to take the seat back, and
+// WATCH asks to follow a table as a spectator
+#define PROTO_INFO_DELTA 0x80
+#define PROTO_ATTACH 0x81
+#define PROTO_SEATED 0x82
+#define PROTO_SESSION 0x83
+#define PROTO_RESUME 0x84
+#define PROTO_WATCH 0x85
+
+// room for one seat's header and hole cards in proto_info_frame()
+#define PROTO_SEAT_SCRATCH (PROTO_HEADER_SIZE + 2)
+
+/**
+ * @brief the part of an INFO that every seat shares, encoded once
+ */
+typedef struct {
+    int type;                           // INFO, or PROTO_INFO_DELTA if it was encoded against a base
+    size_t len;
+    uint8_t body[PROTO_MAX_FRAME];
+} proto_public_t;
+
+/**
+ * @brief the size of the frame at the start of buf
+ *
+ * @return the whole frame's size, 0 if its length has not arrived yet, -1 if
+ *         it cannot be a valid frame
+ */
+int proto_frame_size(const uint8_t *buf, size_t len);
+
+/**
+ * @brief the type of the frame at the start of buf
+ *
+ * @return the type byte, -1 if the header has not arrived yet
+ */
+int proto_frame_type(const uint8_t *buf, size_t len);
+
+/**
+ * @brief encodes a packet as a frame
+ *
+ * @param out at least PROTO_MAX_FRAME bytes
+ * @return the frame's size
+ */
+size_t proto_encode_client(const client_packet_t *pkt, uint8_t *out);
+size_t proto_encode_server(const server_packet_t *pkt, uint8_t *out);
+
+/**
+ * @brief decodes the frame at the start of buf
+ *
+ * @return the frame's size (how much to consume), 0 if the frame is not
+ *         complete yet, -1 if it is malformed
+ */
+int proto_decode_client(const uint8_t *buf, size_t len, client_packet_t *pkt);
+
+/**
+ * @brief encodes an ATTACH frame naming a shared memory channel
+ *
+ * @param out at least PROTO_MAX_FRAME bytes
+ * @return the frame's size
+ */
+size_t proto_encode_attach(const char *name, uint8_t *out);
+
+/**
+ * @brief decodes the ATTACH frame at the start of buf
+ *
+ * @param name filled with the channel's name, NUL terminated
+ * @param cap the room in name
+ * @return the frame's size (how much to consume), 0 if the frame is not
+ *         complete yet, -1 if it is malformed or not an ATTACH
+ */
+int proto_decode_attach(const uint8_t *buf, size_t len, char *name, size_t cap);
+
+/**
+ * @brief encodes a SEATED frame, the answer to a JOIN for ANY_SEAT
+ *
+ * @param out at least PROTO_MAX_FRAME bytes
+ * @return the frame's size
+ */
+size_t proto_encode_seated(player_id_t seat, uint8_t *out);
+
+/**
+ * @brief decodes the SEATED frame at the start of buf
+ *
+ * @return the frame's size (how much to consume), 0 if the frame is not
+ *         complete yet, -1 if it is malformed or not a SEATED
+ */
+int proto_decode_seated(const uint8_t *buf, size_t len, player_id_t *seat);
+
+/**
+ * @brief encodes a SESSION frame carrying a seat's session token
+ *
+ * @param out at least PROTO_MAX_FRAME bytes
+ * @return the frame's size
+ */
+size_t proto_encode_session(uint64_t token, uint8_t *out);
+
+/**
+ * @brief decodes the SESSION frame at the start of buf
+ *
+ * @return the frame's size (how much to consume), 0 if the frame is not
+ *         complete yet, -1 if it is malformed or not a SESSION
+ */
+int proto_decode_session(const uint8_t *buf, size_t len, uint64_t *token);
+
+/**
+ * @brief encodes a RESUME frame, which takes a seat back after a reconnect
+ *
+ * @param out at least PROTO_MAX_FRAME bytes
+ * @return the frame's size
+ */
+size_t proto_encode_resume(int table_id, player_id_t seat, uint64_t token, uint8_t *out);
+
+/**
+ * @brief decodes the RESUME frame at the start of buf
+ *
+ * @return the frame's size (how much to consume), 0 if the frame is not
+ *         complete yet, -1 if it is malformed or not a RESUME
+ */
+int proto_decode_resume(const uint8_t *buf, size_t len, int *table_id, player_id_t *seat, uint64_t *token);
+
+/**
+ * @brief encodes a WATCH frame, which follows a table without a seat
+ *
+ * @param out at least PROTO_MAX_FRAME bytes
+ * @return the frame's size
+ */
+size_t proto_encode_watch(int table_id, uint8_t *out);
+
+/**
+ * @brief decodes the WATCH frame at the start of buf
+ *
+ * @return the frame's size (how much to consume), 0 if the frame is not
+ *         complete yet, -1 if it is malformed or not a WATCH
+ */
+int proto_decode_watch(const uint8_t *buf, size_t len, int *table_id);
+
+/**
+ * @brief encodes the public fields of an INFO (everything but the hole cards)
+ *
+ * @param base the INFO the receivers last got, NULL for a full snapshot
+ */
+void proto_encode_info_public(const info_packet_t *base, const info_packet_t *info, proto_public_t *out);
+
+/**
+ * @brief lays out one seat's frame around a shared public part, without copying it
+ *
+ * @param hole the seat's hole cards, NULL if a delta does not need to repeat them
+ * @param scratch PROTO_SEAT_SCRATCH bytes for the seat's own header and hole cards
+ * @param iov filled with the segments of the frame, at most 3
+ * @return how many segments were filled
+ */
+int proto_info_frame(const proto_public_t *pub, const card_t *hole, uint8_t *scratch, struct iovec *iov);
+
+/**
+ * @brief decodes the server frame at the start of buf
+ *
+ * @param base the last INFO decoded on this connection, NULL if there was none
+ * @return the frame's size (how much to consume), 0 if the frame is not
+ *         complete yet, -1 if it is malformed or a delta arrived without a base
+ */
+int proto_decode_server(const uint8_t *buf, size_t len, const info_packet_t *base, server_packet_t *pkt);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/**
+ * xoshiro256** pseudo random number generator
+ *
+ * every generator is its own stream with no shared state, so separate threads
+ * (or tables) can each own one and draw numbers without any locking. a stream
+ * is fully determined by the (seed, stream) pair it was created with.
+ */
+typedef struct {
+    uint64_t s[4];
+} rng_t;
+
+/**
+ * @brief seeds a generator
+ *
+ * @param rng the generator to seed
+ * @param seed the base seed
+ * @param stream which stream of the seed to use (e.g. a thread or table index)
+ */
+void rng_init(rng_t *rng, uint64_t seed, uint64_t stream);
+
+/**
+ * @brief draws the next 64 random bits
+ */
+uint64_t rng_next(rng_t *rng);
+
+/**
+ * @brief draws a uniformly distributed number in [0, bound) without modulo bias
+ *
+ * @param rng the generator to draw from
+ * @param bound the exclusive upper bound, must be greater than 0
+ */
+uint32_t rng_below(rng_t *rng, uint32_t bound);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <pthread.h>
+
+#include "event_loop.h"
+#include "table.h"
+
+/**
+ * thread-per-core table executor
+ *
+ * each shard is one thread with its own event loop and its own SO_REUSEPORT
+ * listener on the server port, and owns a fixed set of tables picked by
+ * shard_of(). a table and all of its connections only ever live on their
+ * shard, so nothing on the hot path takes a lock.
+ *
+ * the kernel spreads new connections over the listeners without knowing which
+ * table they want. once JOIN names the table, a connection that landed on the
+ * wrong shard is handed to the owner through its inbox. that is the only time
+ * a connection moves between shards. RESUME and WATCH, which also name a
+ * table, are handed over the same way.
+ *
+ * clients on the same host can also connect through a unix domain socket.
+ * the first shard alone listens on it, and those connections reach their
+ * table through the same JOIN handoff. before JOIN they may also switch to a
+ * shared memory channel (see shm_ring.h), which moves with them.
+ */
+
+typedef struct handoff handoff_t;
+
+typedef struct {
+    int id;
+    pthread_t thread;
+    event_loop_t loop;
+    conn_t *listener;
+    conn_t *unix_listener;              // only on the first shard, NULL without a socket path
+    conn_t *notify;                     // wakes the loop for the inbox or shutdown
+    pthread_mutex_t inbox_lock;
+    handoff_t *inbox;                   // connections handed over by other shards
+    int exited;                         // no longer takes handoffs, guarded by inbox_lock
+} shard_t;
+
+/**
+ * @brief the shard that owns a table
+ */
+int shard_of(int table_id);
+
+/**
+ * @brief creates the shards and their tables, and starts listening on port
+ *
+ * @param num_shards how many shards, 0 for one per online cpu (at most one per table)
+ * @param path the unix domain socket to listen on as well, NULL for TCP only
+ * @param cfg how every table is set up
+ * @param backend the event loop backend every shard asks for
+ * @return 0 on success, -1 on failure
+ */
+int shards_init(int num_shards, int num_tables, int port, const char *path, const table_config_t *cfg,
+                loop_backend_t backend);
+
+/**
+ * @brief runs every shard on its own thread until all tables have halted
+ */
+void shards_run(void);
+
+/**
+ * @brief frees the shards and tables
+ */
+void shards_fini(void);
+
+#endif
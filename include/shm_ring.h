@@ -0,0 +1,117 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * shared memory transport between the server and clients on the same host
+ *
+ * a channel is one segment holding a single producer, single consumer byte
+ * ring per direction. the frames written to it are exactly the ones a socket
+ * would carry, so the protocol does not change. reading and writing are plain
+ * loads, stores and copies, no system call is made while both sides are busy.
+ *
+ * a side that runs out of work parks itself on the ring and then sleeps on the
+ * socket the channel was set up over. the other side checks the parked flag
+ * after each read or write and only then rings the doorbell, a single byte on
+ * that socket. the socket also still tells either side when the other is gone.
+ *
+ *      client                                   server
+ *        | connect the unix socket               |
+ *        | ATTACH with the segment's name  ----> | maps it, unlinks the name
+ *        | <------------------------------- bell | once mapped
+ *        | JOIN and everything else via the ring |
+ */
+
+#define SHM_RING_SIZE 8192              // a power of two
+#define SHM_NAME_PREFIX "/poker_shm."
+#define SHM_NAME_MAX 64
+
+typedef struct {
+    _Alignas(64) _Atomic uint32_t head; // bytes ever written, only the producer moves it
+    _Atomic int writer_parked;          // the producer sleeps until there is room
+    _Alignas(64) _Atomic uint32_t tail; // bytes ever read, only the consumer moves it
+    _Atomic int reader_parked;          // the consumer sleeps until there is data
+    _Alignas(64) uint8_t data[SHM_RING_SIZE];
+} shm_ring_t;
+
+typedef struct shm_channel {
+    shm_ring_t up;                      // client to server
+    shm_ring_t down;                    // server to client
+} shm_channel_t;
+
+/**
+ * @brief creates and maps a new channel
+ *
+ * @param name filled with the segment's name, SHM_NAME_MAX bytes
+ * @return the channel, NULL on failure
+ */
+shm_channel_t *shm_channel_create(char *name);
+
+/**
+ * @brief maps a channel another process created, and unlinks its name
+ *
+ * @return the channel, NULL on failure or if name is not a channel's
+ */
+shm_channel_t *shm_channel_open(const char *name);
+
+/**
+ * @brief unmaps a channel
+ */
+void shm_channel_close(shm_channel_t *ch);
+
+/**
+ * @brief bytes waiting to be read
+ */
+size_t shm_ring_used(shm_ring_t *r);
+
+/**
+ * @brief copies as much of buf as fits into the ring
+ *
+ * @return how many bytes were written
+ */
+size_t shm_ring_write(shm_ring_t *r, const void *buf, size_t len);
+
+/**
+ * @brief copies up to len bytes out of the ring
+ *
+ * @return how many bytes were read
+ */
+size_t shm_ring_read(shm_ring_t *r, void *buf, size_t len);
+
+/**
+ * @brief the consumer is about to sleep
+ *
+ * @return 1 if it may, 0 if data arrived meanwhile (and it stays unparked)
+ */
+int shm_ring_park_reader(shm_ring_t *r);
+
+/**
+ * @brief the consumer is awake again and reads without doorbells
+ */
+void shm_ring_unpark_reader(shm_ring_t *r);
+
+/**
+ * @brief the producer is about to sleep because the ring is full
+ *
+ * @return 1 if it may, 0 if room was made meanwhile (and it stays unparked)
+ */
+int shm_ring_park_writer(shm_ring_t *r);
+
+/**
+ * @brief after writing: whether the consumer was parked and must be woken
+ *
+ * unparks it, so it is woken only once
+ */
+int shm_ring_reader_parked(shm_ring_t *r);
+
+/**
+ * @brief after reading: whether the producer was parked and must be woken
+ *
+ * unparks it, so it is woken only once
+ */
+int shm_ring_writer_parked(shm_ring_t *r);
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "poker_client.h"
+#include "game_logic.h"
+#include "event_loop.h"
+#include "feed.h"
+
+/**
+ * one poker table driven by network events
+ *
+ * the table never waits on a socket. packets pile up in each connection's
+ * input buffer and table_pump() takes one whenever the table is waiting on
+ * that seat: every seated player in the ready phase, only the current player
+ * while betting. anything else stays buffered until its turn comes, just as
+ * it used to sit in the socket while the server blocked on somebody else.
+ *
+ * a seat whose connection is congested (the client stopped reading) is sent
+ * no more INFOs and is folded when its turn comes, so it never holds up the
+ * table. when it catches up it gets a full snapshot of the hand.
+ *
+ * the player to act has action_ms to do so. after that the seat's time bank,
+ * which lasts the whole game, starts running down, and once that is gone too
+ * the table checks for the player if that is free and folds otherwise.
+ *
+ * between hands the table is a lobby: players sit down on a seat of their
+ * choice or any free one, and answer READY or LEAVE. a full table starts as
+ * soon as everyone answered, as does one that has played before. otherwise
+ * the ready players wait up to start_ms for the rest, then the hand starts
+ * with whoever is ready and the others sit it out. a player who sits down
+ * during a hand watches it and is dealt in from the next one.
+ *
+ * every seated player gets a session token. one who drops keeps the seat for
+ * resume_ms, during which the turn timer acts for them (without their time
+ * bank), and can take it back by reconnecting with the token. a hand in
+ * progress is then sent again in full. once the window closes the player is
+ * gone for good and the seat is given up as soon as the hand allows.
+ *
+ * any number of spectators, up to max_watchers, can follow the table through
+ * its feed (see feed.h), watch_delay_ms behind the seats.
+ */
+
+typedef enum {
+    TABLE_READY,        // between hands, seating players and waiting for READY or LEAVE
+    TABLE_BETTING,      // a hand is being played
+    TABLE_HALTED        // fewer than two players wanted another hand
+} table_phase_t;
+
+typedef struct {
+    int starting_stack;
+    int seed;
+    int action_ms;                      // time to act before the time bank is used, 0 for no limit
+    int bank_ms;                        // extra time each seat can draw on over the whole game
+    int start_ms;                       // time the ready players wait for the others, 0 to wait for everyone
+    int resume_ms;                      // time a dropped player's seat is held, 0 to give it up at once
+    int max_watchers;                   // spectators the table takes, 0 for none
+    int watch_delay_ms;                 // how far behind the seats the spectators are
+} table_config_t;
+
+typedef struct table table_t;
+
+struct table {
+    int id;
+    game_state_t game;
+    event_loop_t *loop;
+    table_phase_t phase;
+    conn_t *conns[MAX_PLAYERS];         // NULL for an empty seat
+    int answered;                       // seats that answered in the ready phase, one bit each
+    int ready;                          // those of them that are ready and still seated, one bit each
+    int street;                         // 0 preflop to 3 river
+    int todo;                           // actions needed before the street is over
+    int acted;                          // actions taken so far this street
+    info_packet_t sent_public;          // public fields of the last INFO broadcast
+    card_t sent_hole[MAX_PLAYERS][2];   // the hole cards each seat was last sent
+    int info_synced;                    // seats that got sent_public, later INFOs are deltas of it, one bit each
+    int starting_stack;
+    int action_ms;
+    int bank_ms;
+    int start_ms;
+    int resume_ms;
+    tw_timer_t start_timer;             // runs in the ready phase once two players are ready
+    uint64_t tokens[MAX_PLAYERS];       // each seat's session, a reconnect must name it
+    int held;                           // seats whose player dropped but may still come back, one bit each
+    tw_timer_t resume_timer[MAX_PLAYERS];   // runs while a seat is held
+    int time_bank[MAX_PLAYERS];         // ms of time bank each seat has left
+    tw_timer_t turn_timer;              // runs while the table waits on timer_seat
+    player_id_t timer_seat;             // -1 when no turn is being timed
+    int on_bank;                        // the timer is running down timer_seat's time bank
+    uint64_t bank_from;                 // when it started doing so
+    feed_t feed;                        // everything the spectators are sent
+    void (*on_halt)(table_t *t);        // called once the table has halted and its spectators saw it, for the owner
+};
+
+/**
+ * @brief sets up an empty table
+ *
+ * @param id the table's id, it also picks the table's random streams of cfg->seed
+ */
+void table_init(table_t *t, event_loop_t *loop, int id, const table_config_t *cfg);
+
+/**
+ * @brief seats a connection that sent JOIN
+ *
+ * a connection that asked for ANY_SEAT is sent the seat it got.
+ *
+ * @param seat the seat asked for, or ANY_SEAT
+ * @return the seat, -1 if it is taken (or every seat is) or the table halted
+ */
+int table_seat(table_t *t, player_id_t seat, conn_t *c);
+
+/**
+ * @brief gives a seat back to the player it belongs to, on a new connection
+ *
+ * the old connection, if the table has not noticed it dropped yet, is closed.
+ *
+ * @param token the session token the seat was given
+ * @return the seat, -1 if the token is wrong or the seat was given up
+ */
+int table_resume(table_t *t, player_id_t seat, uint64_t token, conn_t *c);
+
+/**
+ * @brief adds a connection that sent WATCH as a spectator
+ *
+ * @return 0 on success, -1 if the table takes no more spectators or halted
+ */
+int table_watch(table_t *t, conn_t *c);
+
+/**
+ * @brief handles input on one of the table's connections
+ */
+void table_data(table_t *t, conn_t *c);
+
+/**
+ * @brief handles every buffered packet the table is waiting for
+ */
+void table_pump(table_t *t);
+
+/**
+ * @brief brings a seat that stopped reading for a while up to date again
+ */
+void table_drained(table_t *t, conn_t *c);
+
+/**
+ * @brief forgets a connection that is being closed
+ */
+void table_detach(table_t *t, conn_t *c);
+
+#endif
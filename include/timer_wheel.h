@@ -0,0 +1,81 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * hierarchical timer wheel with millisecond ticks
+ *
+ * TW_LEVELS wheels of TW_SLOTS slots each: the first holds timers due within
+ * TW_SLOTS ticks, slot by slot, and every further level covers TW_SLOTS times
+ * the span of the one below it. when the first wheel comes round, the next
+ * level's current slot is cascaded down into it. adding, cancelling and
+ * firing a timer are all O(1), and timers are intrusive, so a wheel can carry
+ * any number of them (one per table, say) without allocating.
+ *
+ * a timer further out than the top level can reach is parked in the top
+ * level's last slot and simply cascaded again when that slot comes round.
+ */
+
+#define TW_BITS 6
+#define TW_SLOTS (1 << TW_BITS)
+#define TW_LEVELS 4                     // 2^24 ms, about 4.6 hours before a timer is parked
+
+typedef struct tw_timer tw_timer_t;
+typedef void (*tw_callback_t)(tw_timer_t *timer, void *arg);
+
+struct tw_timer {
+    tw_timer_t *next, *prev;            // in its slot, NULL while not armed
+    uint64_t expires;                   // tick it fires at
+    tw_callback_t fn;
+    void *arg;
+};
+
+typedef struct {
+    uint64_t now;                       // the next tick to run
+    int count;                          // armed timers
+    tw_timer_t slots[TW_LEVELS][TW_SLOTS];  // list heads
+} timer_wheel_t;
+
+/**
+ * @brief sets up an empty wheel whose clock starts at now
+ */
+void tw_init(timer_wheel_t *w, uint64_t now);
+
+/**
+ * @brief arms (or re-arms) a timer to call fn(timer, arg) at tick expires
+ */
+void tw_add(timer_wheel_t *w, tw_timer_t *t, uint64_t expires, tw_callback_t fn, void *arg);
+
+/**
+ * @brief disarms a timer, nothing happens if it is not armed
+ */
+void tw_cancel(timer_wheel_t *w, tw_timer_t *t);
+
+/**
+ * @brief whether a timer is armed
+ */
+static inline int tw_armed(const tw_timer_t *t)
+{
+    return t->next != NULL;
+}
+
+/**
+ * @brief runs the clock up to now, firing every timer due by then
+ *
+ * the clock jumps straight from one tick with something due (a timer or a
+ * cascade) to the next, so a long wait costs no more than a short one. a
+ * callback may add or cancel any timer, including its own
+ */
+void tw_advance(timer_wheel_t *w, uint64_t now);
+
+/**
+ * @brief how long a poller may sleep without missing a timer
+ *
+ * @return ticks from now until the next timer (or cascade) is due, -1 if no
+ *         timer is armed. it may be early but never late
+ */
+int64_t tw_next_timeout(const timer_wheel_t *w, uint64_t now);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * minimal io_uring wrapper over the raw system calls
+ *
+ * requests are queued in the submission ring without any system call and
+ * handed to the kernel together by uring_wait(), which in the same call waits
+ * for completions and copies out as many as are ready. one io_uring_enter()
+ * therefore covers a whole loop iteration of sends and receives.
+ */
+
+typedef struct uring uring_t;
+
+typedef struct {
+    uint64_t user_data;
+    int32_t res;
+} uring_cqe_t;
+
+/**
+ * @brief sets up a ring
+ *
+ * @param entries submission queue size, rounded up to a power of two by the kernel
+ * @return the ring, NULL if io_uring is not available (or too old for this wrapper)
+ */
+uring_t *uring_open(unsigned entries);
+
+void uring_close(uring_t *r);
+
+/**
+ * @brief registers one fixed buffer (index 0) for uring_read_fixed/uring_write_fixed
+ *
+ * @return 0 on success, -1 if it could not be pinned (e.g. RLIMIT_MEMLOCK)
+ */
+int uring_register_buffer(uring_t *r, void *base, size_t len);
+
+/**
+ * @brief registers an empty fixed file table with `count` slots
+ *
+ * @return 0 on success, -1 on failure
+ */
+int uring_register_files(uring_t *r, unsigned count);
+
+/**
+ * @brief puts fd in a fixed file slot, -1 empties the slot
+ *
+ * @return 0 on success, -1 on failure
+ */
+int uring_set_file(uring_t *r, unsigned slot, int fd);
+
+/**
+ * queue a request. `file` is a slot of the fixed file table when `fixed_file`
+ * is set and a plain file descriptor otherwise. the *_fixed variants read into
+ * or write from the registered buffer.
+ */
+void uring_recv(uring_t *r, int file, int fixed_file, void *buf, size_t len, uint64_t user_data);
+void uring_send(uring_t *r, int file, int fixed_file, const void *buf, size_t len, uint64_t user_data);
+void uring_read_fixed(uring_t *r, int file, int fixed_file, void *buf, size_t len, uint64_t user_data);
+void uring_write_fixed(uring_t *r, int file, int fixed_file, const void *buf, size_t len, uint64_t user_data);
+void uring_read(uring_t *r, int fd, void *buf, size_t len, uint64_t user_data);
+void uring_accept(uring_t *r, int fd, uint64_t user_data);
+void uring_cancel(uring_t *r, uint64_t target, uint64_t user_data);
+
+/**
+ * @brief submits every queued request and reaps completions
+ *
+ * @param out where the completions are copied
+ * @param max room in out
+ * @param timeout_ms how long to wait for the first completion, -1 for no limit
+ * @return how many completions were copied
+ */
+int uring_wait(uring_t *r, uring_cqe_t *out, int max, int timeout_ms);
+
+#endif
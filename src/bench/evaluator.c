@@ -0,0 +1,433 @@
+/**
+ * hand evaluator micro-benchmarks
+ *
+ * usage:
+ *  bench.evaluator [-b baseline] [-o out] [-t tolerance] [-m millis] [-s seed]
+ *
+ *  -b      compare against a baseline written by an earlier run, failing on a
+ *          regression larger than the tolerance
+ *  -o      write the results to a file as well as stdout
+ *  -t      allowed slowdown against the baseline in percent (default 25)
+ *  -m      least time spent on each evaluator and set (default 200ms)
+ *  -s      seed of the hand sets (default 1). a baseline is only comparable
+ *          to runs with the same seed
+ *
+ * every evaluator scores the same fixed-seed sets of hands, so their score
+ * checksums must agree; a mismatch fails the run. results are JSON, one
+ * evaluator and set per line. to refresh the stored baseline, copy the output
+ * of a run over scripts/bench/evaluator_baseline.json.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "hand_eval.h"
+#include "rng.h"
+
+#define TABLES 8192             // boards in each set
+#define SEATS 8                 // hands dealt against each board
+#define HANDS (TABLES * SEATS)
+#define MAX_RESULTS 64
+
+typedef struct {
+    const char *name;
+    int board_cards;            // 3, 4 or 5, so hands hold 5, 6 or 7 cards
+    card_t boards[TABLES][BOARD_CARDS];
+    card_t holes[TABLES][SEATS][HOLE_CARDS];
+    hand_state_t board_states[TABLES];
+} hand_set_t;
+
+typedef struct {
+    char evaluator[32];
+    char set[32];
+    long hands;
+    double ns_per_hand;
+    double hands_per_sec;
+    unsigned long checksum;
+} bench_result_t;
+
+typedef unsigned long (*bench_fn_t)(const hand_set_t *set);
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-b baseline] [-o out] [-t tolerance] [-m millis] [-s seed]\n", prog);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// takes a random card from deck[0..*left), removing it
+static card_t draw(rng_t *rng, card_t *deck, int *left)
+{
+    int i = rng_below(rng, *left);
+    card_t card = deck[i];
+    deck[i] = deck[--*left];
+    return card;
+}
+
+// takes a card matching want(card) if one is left, any card otherwise
+static card_t draw_where(rng_t *rng, card_t *deck, int *left, int (*want)(card_t, int), int arg)
+{
+    int matches = 0;
+    for (int i = 0; i < *left; ++i)
+    {
+        matches += want(deck[i], arg);
+    }
+    if (matches == 0) return draw(rng, deck, left);
+
+    int pick = rng_below(rng, matches);
+    for (int i = 0; i < *left; ++i)
+    {
+        if (want(deck[i], arg) && pick-- == 0)
+        {
+            card_t card = deck[i];
+            deck[i] = deck[--*left];
+            return card;
+        }
+    }
+    return draw(rng, deck, left);
+}
+
+static int of_suite(card_t card, int suite) { return SUITE(card) == suite; }
+static int of_rank(card_t card, int rank) { return RANK(card) == rank; }
+
+typedef enum { DEAL_RANDOM, DEAL_FLUSH, DEAL_PAIRED } deal_kind_t;
+
+/**
+ * deals every table of a set. flush heavy sets put three cards of one suite on
+ * the board and favour that suite in the holes; paired sets pair (and often
+ * trip) the board so full houses and quads are common.
+ */
+static void deal_set(hand_set_t *set, const char *name, int board_cards, deal_kind_t kind, rng_t *rng)
+{
+    set->name = name;
+    set->board_cards = board_cards;
+
+    for (int t = 0; t < TABLES; ++t)
+    {
+        card_t deck[DECK_SIZE];
+        int left = DECK_SIZE;
+        for (int c = 0; c < DECK_SIZE; ++c) deck[c] = c;
+
+        card_t *board = set->boards[t];
+        int suite = rng_below(rng, 4);
+        for (int c = 0; c < BOARD_CARDS; ++c)
+        {
+            if (c >= board_cards) board[c] = NOCARD;
+            else if (kind == DEAL_FLUSH && c < 3) board[c] = draw_where(rng, deck, &left, of_suite, suite);
+            else if (kind == DEAL_PAIRED && c > 0 && rng_below(rng, 2)) board[c] = draw_where(rng, deck, &left, of_rank, RANK(board[c - 1]));
+            else board[c] = draw(rng, deck, &left);
+        }
+
+        for (int s = 0; s < SEATS; ++s)
+        {
+            for (int c = 0; c < HOLE_CARDS; ++c)
+            {
+                set->holes[t][s][c] = (kind == DEAL_FLUSH && rng_below(rng, 2))
+                    ? draw_where(rng, deck, &left, of_suite, suite)
+                    : draw(rng, deck, &left);
+            }
+        }
+
+        hand_state_clear(&set->board_states[t]);
+        for (int c = 0; c < board_cards; ++c)
+        {
+            hand_state_add(&set->board_states[t], board[c]);
+        }
+    }
+}
+
+static unsigned long bench_hand_eval(const hand_set_t *set)
+{
+    unsigned long sum = 0;
+    int n = set->board_cards + HOLE_CARDS;
+    for (int t = 0; t < TABLES; ++t)
+    {
+        card_t cards[MAX_EVAL_CARDS];
+        memcpy(cards, set->boards[t], set->board_cards * sizeof(card_t));
+        for (int s = 0; s < SEATS; ++s)
+        {
+            cards[n - 2] = set->holes[t][s][0];
+            cards[n - 1] = set->holes[t][s][1];
+            sum += hand_eval(cards, n);
+        }
+    }
+    return sum;
+}
+
+static unsigned long bench_hand_eval_state(const hand_set_t *set)
+{
+    unsigned long sum = 0;
+    for (int t = 0; t < TABLES; ++t)
+    {
+        for (int s = 0; s < SEATS; ++s)
+        {
+            hand_state_t st = set->board_states[t];
+            hand_state_add(&st, set->holes[t][s][0]);
+            hand_state_add(&st, set->holes[t][s][1]);
+            sum += hand_eval_state(&st);
+        }
+    }
+    return sum;
+}
+
+static unsigned long bench_hand_eval_set(const hand_set_t *set)
+{
+    unsigned long sum = 0;
+    for (int t = 0; t < TABLES; ++t)
+    {
+        cardset_t board = set->board_states[t].cards;
+        for (int s = 0; s < SEATS; ++s)
+        {
+            sum += hand_eval_set(board | CARD_BIT(set->holes[t][s][0]) | CARD_BIT(set->holes[t][s][1]));
+        }
+    }
+    return sum;
+}
+
+static unsigned long bench_batch(const hand_set_t *set)
+{
+    unsigned long sum = 0;
+    int scores[SEATS];
+    for (int t = 0; t < TABLES; ++t)
+    {
+        evaluate_hands_batch(set->boards[t], set->holes[t], SEATS, scores);
+        for (int s = 0; s < SEATS; ++s)
+        {
+            sum += scores[s];
+        }
+    }
+    return sum;
+}
+
+// runs fn over the set until at least min_ns has passed, keeping the fastest pass
+static void run_bench(const char *evaluator, bench_fn_t fn, const hand_set_t *set, double min_ns, bench_result_t *res)
+{
+    unsigned long checksum = fn(set); // warm up the tables and caches
+    double best = 0;
+    double spent = 0;
+    do
+    {
+        double start = now_ns();
+        unsigned long sum = fn(set);
+        double ns = now_ns() - start;
+        if (sum != checksum)
+        {
+            fprintf(stderr, "%s gave different scores on the same hands\n", evaluator);
+            exit(1);
+        }
+        if (best == 0 || ns < best) best = ns;
+        spent += ns;
+    } while (spent < min_ns);
+
+    snprintf(res->evaluator, sizeof res->evaluator, "%s", evaluator);
+    snprintf(res->set, sizeof res->set, "%s", set->name);
+    res->hands = HANDS;
+    res->ns_per_hand = best / HANDS;
+    res->hands_per_sec = HANDS / (best / 1e9);
+    res->checksum = checksum;
+}
+
+static void write_results(FILE *out, const bench_result_t *res, int n)
+{
+    fprintf(out, "{\n  \"kernel\": \"%s\",\n  \"results\": [\n", hand_eval_kernel());
+    for (int i = 0; i < n; ++i)
+    {
+        fprintf(out, "    {\"evaluator\": \"%s\", \"set\": \"%s\", \"hands\": %ld, \"ns_per_hand\": %.3f, "
+                     "\"hands_per_sec\": %.0f, \"checksum\": %lu}%s\n",
+                res[i].evaluator, res[i].set, res[i].hands, res[i].ns_per_hand,
+                res[i].hands_per_sec, res[i].checksum, (i + 1 < n) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+/**
+ * reads the result lines of a file written by write_results. the format is
+ * our own, so each result is matched on its line rather than parsing JSON.
+ */
+static int read_results(const char *path, bench_result_t *res, int max)
+{
+    FILE *in = fopen(path, "r");
+    if (!in) return -1;
+
+    char line[512];
+    int n = 0;
+    while (n < max && fgets(line, sizeof line, in))
+    {
+        bench_result_t *r = &res[n];
+        if (sscanf(line, " {\"evaluator\": \"%31[^\"]\", \"set\": \"%31[^\"]\", \"hands\": %ld, \"ns_per_hand\": %lf, "
+                         "\"hands_per_sec\": %lf, \"checksum\": %lu}",
+                   r->evaluator, r->set, &r->hands, &r->ns_per_hand, &r->hands_per_sec, &r->checksum) == 6)
+        {
+            ++n;
+        }
+    }
+    fclose(in);
+    return n;
+}
+
+// reports each result against the baseline, returning how many regressed
+static int compare_results(const bench_result_t *res, int n, const bench_result_t *base, int nbase, double tolerance)
+{
+    int regressions = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        const bench_result_t *b = NULL;
+        for (int j = 0; j < nbase && !b; ++j)
+        {
+            if (strcmp(base[j].evaluator, res[i].evaluator) == 0 && strcmp(base[j].set, res[i].set) == 0)
+            {
+                b = &base[j];
+            }
+        }
+        if (!b)
+        {
+            fprintf(stderr, "%-16s %-10s %8.2f ns/hand  (not in baseline)\n", res[i].evaluator, res[i].set, res[i].ns_per_hand);
+            continue;
+        }
+
+        double change = 100.0 * (res[i].ns_per_hand - b->ns_per_hand) / b->ns_per_hand;
+        const char *verdict = "";
+        if (b->checksum != res[i].checksum)
+        {
+            verdict = "  SCORES CHANGED";
+            ++regressions;
+        }
+        else if (change > tolerance)
+        {
+            verdict = "  REGRESSION";
+            ++regressions;
+        }
+        fprintf(stderr, "%-16s %-10s %8.2f ns/hand  baseline %8.2f  %+6.1f%%%s\n",
+                res[i].evaluator, res[i].set, res[i].ns_per_hand, b->ns_per_hand, change, verdict);
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *baseline = NULL;
+    const char *out_path = NULL;
+    double tolerance = 25;
+    double min_ms = 200;
+    unsigned long long seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:o:t:m:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            baseline = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 't':
+            tolerance = atof(optarg);
+            break;
+        case 'm':
+            min_ms = atof(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    hand_eval_init();
+    const char *native_kernel = hand_eval_kernel();
+
+    static hand_set_t sets[5];
+    rng_t rng;
+    rng_init(&rng, seed, 0);
+    deal_set(&sets[0], "random5", 3, DEAL_RANDOM, &rng);
+    deal_set(&sets[1], "random6", 4, DEAL_RANDOM, &rng);
+    deal_set(&sets[2], "random7", 5, DEAL_RANDOM, &rng);
+    deal_set(&sets[3], "flush7", 5, DEAL_FLUSH, &rng);
+    deal_set(&sets[4], "paired7", 5, DEAL_PAIRED, &rng);
+    int num_sets = sizeof sets / sizeof sets[0];
+
+    static const struct {
+        const char *name;
+        bench_fn_t fn;
+        const char *kernel;     // batch kernel to select first, if any
+    } evaluators[] = {
+        { "hand_eval", bench_hand_eval, NULL },
+        { "hand_eval_state", bench_hand_eval_state, NULL },
+        { "hand_eval_set", bench_hand_eval_set, NULL },
+        { "batch_scalar", bench_batch, "scalar" },
+        { "batch_sse4", bench_batch, "sse4" },
+        { "batch_avx2", bench_batch, "avx2" },
+    };
+
+    bench_result_t results[MAX_RESULTS];
+    int n = 0;
+    for (size_t e = 0; e < sizeof evaluators / sizeof evaluators[0]; ++e)
+    {
+        if (evaluators[e].kernel && hand_eval_use_kernel(evaluators[e].kernel) < 0)
+        {
+            fprintf(stderr, "skipping %s: not supported on this cpu\n", evaluators[e].name);
+            continue;
+        }
+        for (int s = 0; s < num_sets; ++s)
+        {
+            run_bench(evaluators[e].name, evaluators[e].fn, &sets[s], min_ms * 1e6, &results[n++]);
+        }
+    }
+    hand_eval_use_kernel(native_kernel);
+
+    // every evaluator scored the same hands, so they must agree on each set
+    int mismatches = 0;
+    for (int i = num_sets; i < n; ++i)
+    {
+        const bench_result_t *ref = &results[i % num_sets];
+        if (results[i].checksum != ref->checksum)
+        {
+            fprintf(stderr, "%s disagrees with %s on %s\n", results[i].evaluator, ref->evaluator, results[i].set);
+            ++mismatches;
+        }
+    }
+
+    write_results(stdout, results, n);
+    if (out_path)
+    {
+        FILE *out = fopen(out_path, "w");
+        if (!out)
+        {
+            perror(out_path);
+            return 1;
+        }
+        write_results(out, results, n);
+        fclose(out);
+    }
+    if (mismatches) return 1;
+
+    if (baseline)
+    {
+        bench_result_t base[MAX_RESULTS];
+        int nbase = read_results(baseline, base, MAX_RESULTS);
+        if (nbase < 0)
+        {
+            perror(baseline);
+            return 1;
+        }
+        int regressions = compare_results(results, n, base, nbase, tolerance);
+        if (regressions)
+        {
+            fprintf(stderr, "%d result(s) regressed past %.0f%% of the baseline\n", regressions, tolerance);
+            return 2;
+        }
+    }
+    return 0;
+}
@@ -561,7 +561,8 @@ static void send_leave(button_t *button)
 static void send_check(button_t *button)
 {
     int ret = check();
-    if (ret == 0) recv_packet(&serv_pkt);
+    // refused once the turn timer acted for us, the packets the hand went on with are then waiting
+    if (ret == 0 || has_packet_waiting()) recv_packet(&serv_pkt);
     log_err("sending CHECK packet failed.");
 }
 
@@ -651,14 +652,14 @@ static int get_raise_amount(int check_enabled)
 static void send_call(button_t *button)
 {
     int ret = call();
-    if (ret == 0) recv_packet(&serv_pkt);
+    if (ret == 0 || has_packet_waiting()) recv_packet(&serv_pkt);
     log_err("sending CALL packet failed.");
 }
 
 static void send_fold(button_t *button)
 {
     int ret = fold();
-    if (ret == 0) recv_packet(&serv_pkt);
+    if (ret == 0 || has_packet_waiting()) recv_packet(&serv_pkt);
     log_err("sending FOLD packet failed.");
 }
 
@@ -683,7 +684,7 @@ static void send_raise(button_t *button)
     }
     
     int ret = bet_raise(amount);
-    if (ret == 0) recv_packet(&serv_pkt);
+    if (ret == 0 || has_packet_waiting()) recv_packet(&serv_pkt);
 
     log_err("sending RAISE packet failed.");
     poker_game_screen(&serv_pkt.info); // try again
@@ -701,7 +702,18 @@ static void draw_end_info(end_packet_t* pkt)
     // write pot and bet amount
     write_pot_value(&poker_screen, pkt->pot_size);
 
-    write_player_winner(&poker_screen, pkt->winner);
+    // mark everyone who won a share of any pot
+    for (player_id_t player_id = 0; player_id < MAX_PLAYERS; ++player_id)
+    {
+        for (int i = 0; i < pkt->num_pots; ++i)
+        {
+            if (pkt->pots[i].winners & (1 << player_id))
+            {
+                write_player_winner(&poker_screen, player_id);
+                break;
+            }
+        }
+    }
 
     // set player info
     for (player_id_t player_id = 0; player_id < MAX_PLAYERS; ++player_id)
@@ -803,8 +815,8 @@ static void draw_poker_info(info_packet_t *pkt)
     // set player dealer 
     write_player_dealer(&poker_screen, pkt->dealer);
 
-    // set player turn
-    write_player_turn(&poker_screen, pkt->player_turn);
+    // set player turn, nobody has one while the board is run out
+    if (pkt->player_turn >= 0) write_player_turn(&poker_screen, pkt->player_turn);
 
     // draw community cards
     for (size_t i = 0; i < 5; ++i)
@@ -7,7 +7,18 @@
  *  - call
  *  - check
  *  - fold
+ *  - sleep SECONDS
+ *  - drop (hang up without leaving, the server holds the seat for a while)
+ *  - resume (take the seat back after a drop)
+ *  - resume TOKEN (try to take it back with some other token)
  * 
+ * the seat may be given as "any" to take whichever seat the server has free,
+ * the log is then named after the seat it hands out.
+ *
+ * run as "watch NUM [TABLE]" instead of a seat to follow a table as a spectator.
+ * it reads no commands and only logs what it is sent, to spectatorNUM.logs,
+ * until the table halts.
+ *
  * if EOF is reached in stdin, then the client will fold if it recieves an INFO packet until
  * the next END packet. At the next END packet, the client will leave the table then. 
  */
@@ -18,9 +29,11 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "logs.h"
 #include "poker_client.h"
+#include "preflop_table.h"
 
 player_id_t id;
 server_packet_t serv_pkt;
@@ -30,9 +43,12 @@ size_t line_len = 0;
 
 int done_reading = 0;
 
+// mapped once at startup, NULL if no table has been generated
+const preflop_table_t *preflop = NULL;
+
 typedef void(*command_t)(int argc, char *argv[]);
 
-#define TOTAL_COMMANDS 6
+#define TOTAL_COMMANDS 9
 
 static void ready_command(int argc, char *argv[])
 {
@@ -58,14 +74,11 @@ static void leave_command(int argc, char *argv[])
         return;
     }
 
-    int ret = leave();
-    if (ret == 0)
-    {
-        disconnect_to_serv();
-        log_fini();
-        exit(0);
-    }
-    // otherwise, continue the loop
+    // a client that dropped has nobody to tell, it is done all the same
+    leave();
+    disconnect_to_serv();
+    log_fini();
+    exit(0);
 }
 
 static void raise_command(int argc, char *argv[])
@@ -136,13 +149,81 @@ static void fold_command(int argc, char *argv[])
     // otherwise, continue the loop
 }
 
+// holds the script up, e.g. to keep the table waiting on this player for a while
+static void sleep_command(int argc, char *argv[])
+{
+    int required_argc = 1;
+    if (argc != required_argc + 1)
+    {
+        log_err("Wrong number of args (given: %d, required: %d) for CLI command '%s'", argc - 1, required_argc, argv[0]);
+        return;
+    }
+
+    double seconds = atof(argv[1]);
+    if (seconds <= 0) return;
+
+    struct timespec tm;
+    tm.tv_sec = (time_t) seconds;
+    tm.tv_nsec = (long) ((seconds - tm.tv_sec) * 1e9);
+    nanosleep(&tm, NULL);
+    // otherwise, continue the loop
+}
+
+static void drop_command(int argc, char *argv[])
+{
+    int required_argc = 0;
+    if (argc != required_argc + 1)
+    {
+        log_err("Wrong number of args (given: %d, required: %d) for CLI command '%s'", argc - 1, required_argc, argv[0]);
+        return;
+    }
+
+    if (disconnect_to_serv() == 0) log_info("[Client] Dropped the connection");
+    // otherwise, continue the loop
+}
+
+static void resume_command(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2)
+    {
+        log_err("Wrong number of args (given: %d, required: 0 or 1) for CLI command '%s'", argc - 1, argv[0]);
+        return;
+    }
+
+    if (argc == 1)
+    {
+        if (reconnect_to_table() == 0)
+        {
+            recv_packet(&serv_pkt);
+            return;
+        }
+
+        // the seat is gone, there is nothing left to play
+        disconnect_to_serv();
+        log_fini();
+        exit(0);
+    }
+
+    int table_id;
+    player_id_t seat;
+    uint64_t token;
+    if (get_session(&table_id, &seat, &token) < 0) return;
+
+    int ret = resume_seat(table_id, seat, strtoull(argv[1], NULL, 0));
+    if (ret == 0) recv_packet(&serv_pkt);
+    // otherwise, continue the loop
+}
+
 static const char *command_names[TOTAL_COMMANDS] = {
     "ready",
     "leave",
     "raise",
     "call",
     "check",
-    "fold"
+    "fold",
+    "sleep",
+    "drop",
+    "resume"
 };
 
 static command_t command_list[TOTAL_COMMANDS] = {
@@ -151,7 +232,10 @@ static command_t command_list[TOTAL_COMMANDS] = {
     raise_command,
     call_command,
     check_command,
-    fold_command
+    fold_command,
+    sleep_command,
+    drop_command,
+    resume_command
 };
 
 // commands
@@ -241,6 +325,18 @@ static void show_info_pkt(info_packet_t *pkt)
     printf("POT SIZE: %d\n", pkt->pot_size);
     printf("BET SIZE: %d\n", pkt->bet_size);
     printf("YOUR CARDS: %s %s\n", card_name(pkt->player_cards[0]), card_name(pkt->player_cards[1]));
+    if (preflop && pkt->community_cards[0] == NOCARD && pkt->player_cards[0] != NOCARD)
+    {
+        int opponents = -1;
+        for (player_id_t player_id = 0; player_id < MAX_PLAYERS; ++player_id)
+        {
+            if (pkt->player_status[player_id] == 1) ++opponents;
+        }
+        printf("PREFLOP EQUITY: %.1f%% against %d\n", 
+            100 * preflop_equity(preflop, pkt->player_cards[0], pkt->player_cards[1], opponents),
+            opponents
+        );
+    }
     if (pkt->community_cards[0] != NOCARD)
     {
         printf("COMMUNITY CARDS: %s %s %s %s %s\n", 
@@ -287,6 +383,9 @@ static void on_info(info_packet_t *pkt)
                 log_info("No more lines of input. Leaving when available.");
                 done_reading = 1;
             }
+
+            // a refused action with packets waiting means the turn was taken for us, the hand went on
+            if (has_packet_waiting()) recv_packet(&serv_pkt);
         }
     }    
     else
@@ -302,6 +401,16 @@ static void show_end_pkt(end_packet_t *pkt)
     printf("DEALER: PLAYER %d\n", pkt->dealer);
     printf("POT SIZE: %d\n", pkt->pot_size);
 
+    for (int i = 0; i < pkt->num_pots; ++i)
+    {
+        printf("%s %d: %d TO PLAYER(S)", i == 0 ? "MAIN POT" : "SIDE POT", i, pkt->pots[i].amount);
+        for (player_id_t player_id = 0; player_id < MAX_PLAYERS; ++player_id)
+        {
+            if (pkt->pots[i].winners & (1 << player_id)) printf(" %d", player_id);
+        }
+        printf("\n");
+    }
+
     if (pkt->community_cards[0] != NOCARD)
     {
         printf("COMMUNITY CARDS: %s %s %s %s %s\n", 
@@ -357,39 +466,106 @@ static void on_end(end_packet_t *pkt)
     }
 }
 
+// a spectator has nothing to say, it logs what it is sent until the HALT
+static void watch(int argc, char *argv[])
+{
+    int num;
+    int table_id = 0;
+
+    if (argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "incorrect number of args. expecting 2 or 3, got %d.\n", argc - 1);
+        exit(1);
+    }
+
+    if (sscanf(argv[2], " %d ", &num) != 1 || num < 0)
+    {
+        fprintf(stderr, "spectator arg is not a valid number.\n");
+        exit(1);
+    }
+
+    if (argc == 4 && (sscanf(argv[3], " %d ", &table_id) != 1 || table_id < 0))
+    {
+        fprintf(stderr, "table arg is not a valid table.\n");
+        exit(1);
+    }
+
+    log_table_spectator_init(table_id, num);
+    if (watch_table(table_id) == -1)
+    {
+        log_err("Failed to connect to server as a spectator of table %d. Exiting...", table_id);
+        exit(1);
+    }
+
+    set_on_halt_packet_handler(on_halt);
+    while (recv_packet(&serv_pkt) == 0);
+
+    // the server hangs up without a HALT on a spectator it has no room for
+    disconnect_to_serv();
+    log_fini();
+    exit(1);
+}
+
 // main
 
 int main(int argc, char *argv[])
 {
     int ret;
+    int table_id = 0;
 
-    if (argc != 2) 
+    if (argc > 1 && strcmp(argv[1], "watch") == 0) watch(argc, argv);
+
+    if (argc != 2 && argc != 3) 
     {
-        fprintf(stderr, "incorrect number of args. expecting 1, got %d.\n", argc - 1);
+        fprintf(stderr, "incorrect number of args. expecting 1 or 2, got %d.\n", argc - 1);
         return 1;
     }
 
-    if (sscanf(argv[1], " %d ", &id) != 1)
+    int any_seat = strcmp(argv[1], "any") == 0;
+    if (any_seat) id = ANY_SEAT;
+    else if (sscanf(argv[1], " %d ", &id) != 1)
     {
         fprintf(stderr, "required arg is not integer.\n");
         return 1;
     }
 
-    if (id < 0 || id >= MAX_PLAYERS)
+    if (!any_seat && (id < 0 || id >= MAX_PLAYERS))
     {
         fprintf(stderr, "required arg is not in range.\n");
         return 1;
     }
 
-    log_player_init(id);
+    if (argc == 3 && (sscanf(argv[2], " %d ", &table_id) != 1 || table_id < 0))
+    {
+        fprintf(stderr, "table arg is not a valid table.\n");
+        return 1;
+    }
 
-    // attempt to connect to the server
-    ret = connect_to_serv(id);
-    if (ret == -1) // connection failed 
-    {   
-        log_err("Failed to connect to server as player %d. Exiting...", id);
-        exit(1);        
-    }   
+    if (any_seat)
+    {
+        // the log is named after the seat, which only the server knows until we are seated
+        id = connect_to_any_seat(table_id);
+        if (id == -1)
+        {
+            fprintf(stderr, "no seat at table %d.\n", table_id);
+            exit(1);
+        }
+        log_table_player_init(table_id, id);
+        log_info("[Server ~> Client] Seated at seat %d", id);
+    }
+    else
+    {
+        log_table_player_init(table_id, id);
+
+        // attempt to connect to the server
+        ret = connect_to_table(table_id, id);
+        if (ret == -1) // connection failed 
+        {   
+            log_err("Failed to connect to server as player %d at table %d. Exiting...", id, table_id);
+            exit(1);        
+        }   
+    }
+    preflop = preflop_table_open(NULL);
 
     set_on_info_packet_handler(on_info);
     set_on_end_packet_handler(on_end);
@@ -398,6 +574,7 @@ int main(int argc, char *argv[])
     on_end(NULL);
 
     disconnect_to_serv();
+    preflop_table_close(preflop);
     log_fini();
 
     return 0; 
@@ -4,25 +4,51 @@
 #include <unistd.h>
 #include <time.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
 #include "poker_client.h"
+#include "protocol.h"
+#include "shm_ring.h"
 #include "utility.h"
 #include "logs.h"
 
 #define SERVER_IP   "127.0.0.1"
 #define BASE_PORT 2201
-#define NUM_PORTS 6
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE 4096                // as much as the server queues for one connection
+#define SHM_SPINS 4096                  // polls of an empty ring before sleeping, a reply is often that close
 
 // Static vars
 static int client_fd = -1;
+static const char *socket_path = NULL;
+static int socket_path_set = 0;
+static int shm_enabled = 0;
+static int shm_enabled_set = 0;
+
+// the shared memory channel the packets travel over instead of client_fd, if any
+static shm_channel_t *shm = NULL;
+static char shm_name[SHM_NAME_MAX];
 static info_packet_handler_t info_handler = NULL;
 static end_packet_handler_t end_handler = NULL;
 static on_halt_packet_handler_t halt_handler = NULL;
 static server_packet_t last_server_packet;
 static int halt_received = 0;
 
+// bytes received from the server that do not make up a whole frame yet
+static uint8_t rx_buf[BUFFER_SIZE];
+static size_t rx_len = 0;
+
+// the last INFO from the server, the base its next delta applies to
+static info_packet_t last_info;
+static int have_info = 0;
+
+// the seat we hold, and the token that takes it back after a dropped connection
+static int session_table = 0;
+static player_id_t session_seat = 0;
+static uint64_t session_token = 0;
+static int have_session = 0;
+
 static const char *CLIENT_PACKET_TYPE_NAMES[] = {
     "JOIN",
     "LEAVE",
@@ -77,6 +103,13 @@ void log_end_packet(const end_packet_t *end) {
         }
     }
 
+    // a single pot with a single winner is already described by the line above
+    for (int i = 0; i < end->num_pots; i++) {
+        if (end->num_pots == 1 && __builtin_popcount(end->pots[i].winners) == 1) break;
+        log_info("[END_PACKET] Pot %d: amount=%d, winners=0x%02x",
+                 i, end->pots[i].amount, end->pots[i].winners);
+    }
+
     for (int i = 0; i < MAX_PLAYERS; i++) {
         log_info("[END_PACKET] Player %d Final Stack=%d, Cards: %s %s", 
                  i, end->player_stacks[i],
@@ -90,26 +123,223 @@ void log_end_packet(const end_packet_t *end) {
 #define NANOSEC_IN_SEC 1000000000ul
 #define MAX_CONNECTION_ATTEMPT_TIME 7500000000ul
 
+static int send_all(const uint8_t *buf, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(client_fd, buf + sent, len - sent, 0);
+        if (n <= 0) return -1;
+        sent += n;
+    }
+    return 0;
+}
+
+// with shared memory the socket only carries doorbells, one byte each
+static int ring_bell() {
+    uint8_t bell = 0;
+    return send(client_fd, &bell, 1, 0) == 1 ? 0 : -1;
+}
+
+// sleeps until the server rings, -1 if it hung up
+static int wait_bell() {
+    uint8_t bells[16];
+    return recv(client_fd, bells, sizeof(bells), 0) > 0 ? 0 : -1;
+}
+
+static int shm_send(const uint8_t *buf, size_t len) {
+    shm_ring_t *r = &shm->up;
+    while (len > 0) {
+        size_t n = shm_ring_write(r, buf, len);
+        buf += n;
+        len -= n;
+        if (n > 0 && shm_ring_reader_parked(r) && ring_bell() < 0) return -1;
+        if (len > 0 && shm_ring_park_writer(r) && wait_bell() < 0) return -1;
+    }
+    return 0;
+}
+
+static ssize_t shm_recv(uint8_t *buf, size_t len) {
+    shm_ring_t *r = &shm->down;
+    for (int spins = 0; ; ++spins) {
+        size_t n = shm_ring_read(r, buf, len);
+        if (n > 0) {
+            if (shm_ring_writer_parked(r) && ring_bell() < 0) return -1;
+            return n;
+        }
+        if (spins < SHM_SPINS) continue;
+        if (shm_ring_park_reader(r)) {
+            if (wait_bell() < 0) return -1;
+            shm_ring_unpark_reader(r);
+        }
+    }
+}
+
+static int send_bytes(const uint8_t *buf, size_t len) {
+    return shm ? shm_send(buf, len) : send_all(buf, len);
+}
+
+static int send_frame(const client_packet_t *pkt) {
+    uint8_t frame[PROTO_MAX_FRAME];
+    return send_bytes(frame, proto_encode_client(pkt, frame));
+}
+
+// the server hands out a session token whenever it gives us a seat
+static int take_session() {
+    int size = proto_decode_session(rx_buf, rx_len, &session_token);
+    if (size > 0) {
+        have_session = 1;
+        rx_len -= size;
+        memmove(rx_buf, rx_buf + size, rx_len);
+    }
+    return size;
+}
+
+// appends whatever the server sent next to rx_buf
+static int fill_rx() {
+    ssize_t n = shm ? shm_recv(rx_buf + rx_len, sizeof(rx_buf) - rx_len)
+                    : recv(client_fd, rx_buf + rx_len, sizeof(rx_buf) - rx_len, 0);
+    if (n <= 0) return -1;
+    rx_len += n;
+    return 0;
+}
+
+// reads until a whole frame has arrived, however the stream was split up
+static int recv_frame(server_packet_t *pkt) {
+    while (1) {
+        if (proto_frame_type(rx_buf, rx_len) == PROTO_SESSION && take_session() > 0) continue;
+        int size = proto_decode_server(rx_buf, rx_len, have_info ? &last_info : NULL, pkt);
+        if (size < 0) {
+            log_err("malformed frame from server");
+            return -1;
+        }
+        if (size > 0) {
+            rx_len -= size;
+            memmove(rx_buf, rx_buf + size, rx_len);
+            if (pkt->packet_type == INFO) {
+                last_info = pkt->info;
+                have_info = 1;
+            }
+            return 0;
+        }
+
+        if (fill_rx() < 0) return -1;
+    }
+}
+
+// waits for the answer to an action. an INFO or END that comes first, e.g. of the
+// turn the table took for us while we were slow, stays in rx_buf for recv_packet
+static int recv_reply(server_packet_t *pkt) {
+    size_t off = 0;
+    while (1) {
+        int size = proto_frame_size(rx_buf + off, rx_len - off);
+        if (size < 0) {
+            log_err("malformed frame from server");
+            return -1;
+        }
+        if (size > 0 && off + size <= rx_len) {
+            int type = proto_frame_type(rx_buf + off, rx_len - off);
+            if (type != ACK && type != NACK) {
+                off += size;
+                continue;
+            }
+            if (proto_decode_server(rx_buf + off, size, NULL, pkt) != size) {
+                log_err("malformed frame from server");
+                return -1;
+            }
+            rx_len -= size;
+            memmove(rx_buf + off, rx_buf + off + size, rx_len - off);
+            return 0;
+        }
+
+        if (rx_len == sizeof(rx_buf)) {
+            log_err("no answer from server among what it sent");
+            return -1;
+        }
+        if (fill_rx() < 0) return -1;
+    }
+}
+
+static void close_shm() {
+    if (!shm) return;
+    shm_channel_close(shm);
+    shm = NULL;
+    // the server unlinks the name once it maps the channel, unless it never got that far
+    shm_unlink(shm_name);
+}
+
 int connect_to_serv(player_id_t player_id) {
-    struct sockaddr_in serv_addr;
+    return connect_to_table(0, player_id);
+}
+
+void set_server_socket(const char *path) {
+    socket_path = path;
+    socket_path_set = 1;
+}
+
+void set_server_shm(int enabled) {
+    shm_enabled = enabled;
+    shm_enabled_set = 1;
+}
 
-    int port = BASE_PORT + player_id;
+// hands the server a fresh channel, everything after this goes through it
+static int attach_shm() {
+    uint8_t frame[PROTO_MAX_FRAME];
 
-    client_fd = socket(AF_INET, SOCK_STREAM, 0);
+    shm = shm_channel_create(shm_name);
+    if (!shm) return -1;
+    // a client that wrote and hung up before the server mapped the channel would
+    // take the name, and its packets, along. the server rings once it has it
+    if (send_all(frame, proto_encode_attach(shm_name, frame)) < 0 || wait_bell() < 0) {
+        close_shm();
+        return -1;
+    }
+    return 0;
+}
+
+// connects and, for shared memory, attaches, everything short of taking a seat
+static int open_connection() {
+    struct sockaddr_in serv_addr;
+    struct sockaddr_un unix_addr;
+    struct sockaddr *addr;
+    socklen_t addr_len;
+
+    int port = BASE_PORT;
+    const char *path = socket_path_set ? socket_path : getenv(SERVER_SOCKET_ENV);
+    int use_shm = shm_enabled_set ? shm_enabled : getenv(SERVER_SHM_ENV) != NULL;
+    if (use_shm && !path) path = SERVER_SOCKET_PATH;
+
+    client_fd = socket(path ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+    rx_len = 0;
+    have_info = 0;
     if (client_fd < 0) {
         log_err("socket failed in connect_to_serv");
         return -1;
     }
 
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(port);
-
-    if (inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0) {
-        log_err("inet_pton failed in connect_to_serv");
-        close(client_fd);
-        client_fd = -1;
-        return -1;
+    if (path) {
+        memset(&unix_addr, 0, sizeof(unix_addr));
+        unix_addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(unix_addr.sun_path)) {
+            log_err("socket path too long in connect_to_serv");
+            close(client_fd);
+            client_fd = -1;
+            return -1;
+        }
+        strcpy(unix_addr.sun_path, path);
+        addr = (struct sockaddr *)&unix_addr;
+        addr_len = sizeof(unix_addr);
+    } else {
+        memset(&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_port = htons(port);
+
+        if (inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0) {
+            log_err("inet_pton failed in connect_to_serv");
+            close(client_fd);
+            client_fd = -1;
+            return -1;
+        }
+        addr = (struct sockaddr *)&serv_addr;
+        addr_len = sizeof(serv_addr);
     }
 
     int connection_success = 0;
@@ -117,7 +347,7 @@ int connect_to_serv(player_id_t player_id) {
     struct timespec tm;
     for (size_t timer = 100000000; timer < MAX_CONNECTION_ATTEMPT_TIME; timer *= 2)
     {
-        if (connect(client_fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) >= 0) 
+        if (connect(client_fd, addr, addr_len) >= 0) 
         {
             connection_success = 1;
             break;
@@ -137,14 +367,36 @@ int connect_to_serv(player_id_t player_id) {
         return -1;
     }
 
-    log_info("[Client] Successfully connected to server at %s:%d", SERVER_IP, port);
+    if (use_shm && attach_shm() < 0) {
+        log_err("shared memory failed in connect_to_serv");
+        close(client_fd);
+        client_fd = -1;
+        return -1;
+    }
+
+    if (use_shm)
+        log_info("[Client] Successfully connected to server at %s, over shared memory", path);
+    else if (path)
+        log_info("[Client] Successfully connected to server at %s", path);
+    else
+        log_info("[Client] Successfully connected to server at %s:%d", SERVER_IP, port);
+    return 0;
+}
+
+int connect_to_table(int table_id, player_id_t player_id) {
+    if (open_connection() < 0) return -1;
+    session_table = table_id;
+    session_seat = player_id;
+    have_session = 0;
 
     client_packet_t pkt = { 0 };
     pkt.packet_type = JOIN;
+    pkt.params[0] = table_id;
+    pkt.params[1] = player_id;
 
     log_info("[Client ~> Server] Sending packet: type=%s", CLIENT_PACKET_TYPE_NAMES[pkt.packet_type]);
 
-    if (send(client_fd, &pkt, sizeof(client_packet_t), 0) <= 0) {
+    if (send_frame(&pkt) < 0) {
         log_err("send failed in join.");
         return -1;
     }
@@ -152,8 +404,104 @@ int connect_to_serv(player_id_t player_id) {
     return 0;
 }
 
+int connect_to_any_seat(int table_id) {
+    if (connect_to_table(table_id, ANY_SEAT) < 0) return -1;
+
+    // the server answers with the seat before anything else, or hangs up if the table is full
+    player_id_t seat;
+    while (1) {
+        int size = proto_decode_seated(rx_buf, rx_len, &seat);
+        if (size < 0) {
+            log_err("malformed frame from server");
+            disconnect_to_serv();
+            return -1;
+        }
+        if (size > 0) {
+            rx_len -= size;
+            memmove(rx_buf, rx_buf + size, rx_len);
+            break;
+        }
+        if (fill_rx() < 0) {
+            log_err("no free seat at table %d", table_id);
+            disconnect_to_serv();
+            return -1;
+        }
+    }
+
+    log_info("[Server ~> Client] Seated at seat %d", seat);
+    session_seat = seat;
+    return seat;
+}
+
+// asks for a seat back, -1 if the server is unreachable and -2 if it refuses
+static int resume(int table_id, player_id_t seat, uint64_t token) {
+    disconnect_to_serv();
+    if (open_connection() < 0) return -1;
+
+    uint8_t frame[PROTO_MAX_FRAME];
+    log_info("[Client ~> Server] Resuming seat %d at table %d", seat, table_id);
+    if (send_bytes(frame, proto_encode_resume(table_id, seat, token, frame)) < 0) {
+        log_err("send failed in resume_seat");
+        disconnect_to_serv();
+        return -1;
+    }
+
+    // the server confirms with the token before anything else, or hangs up if the seat is not ours
+    while (1) {
+        int size = take_session();
+        if (size < 0) {
+            log_err("malformed frame from server");
+            disconnect_to_serv();
+            return -1;
+        }
+        if (size > 0) break;
+        if (fill_rx() < 0) {
+            log_err("seat %d at table %d is not ours", seat, table_id);
+            disconnect_to_serv();
+            return -2;
+        }
+    }
+    session_table = table_id;
+    session_seat = seat;
+    return 0;
+}
+
+int reconnect_to_table() {
+    if (!have_session) return -1;
+    int ret = resume(session_table, session_seat, session_token);
+    if (ret == -2) have_session = 0;
+    return ret < 0 ? -1 : 0;
+}
+
+int resume_seat(int table_id, player_id_t seat, uint64_t token) {
+    return resume(table_id, seat, token) < 0 ? -1 : 0;
+}
+
+int get_session(int *table_id, player_id_t *seat, uint64_t *token) {
+    if (!have_session) return -1;
+    *table_id = session_table;
+    *seat = session_seat;
+    *token = session_token;
+    return 0;
+}
+
+int watch_table(int table_id) {
+    if (open_connection() < 0) return -1;
+    have_session = 0;
+
+    uint8_t frame[PROTO_MAX_FRAME];
+    log_info("[Client ~> Server] Watching table %d", table_id);
+    if (send_bytes(frame, proto_encode_watch(table_id, frame)) < 0) {
+        log_err("send failed in watch_table");
+        disconnect_to_serv();
+        return -1;
+    }
+    return 0;
+}
+
 int disconnect_to_serv() {
     if (client_fd >= 0) {
+        close_shm();
         close(client_fd);
         client_fd = -1;
         return 0;
@@ -169,7 +517,7 @@ int send_packet(client_packet_t *pkt) {
     else
         log_info("[Client ~> Server] Sending packet: type=%s", CLIENT_PACKET_TYPE_NAMES[pkt->packet_type]);
 
-    if (send(client_fd, pkt, sizeof(client_packet_t), 0) <= 0) {
+    if (send_frame(pkt) < 0) {
         log_err("send failed in send_packet");
         return -1;
     }
@@ -179,7 +527,7 @@ int send_packet(client_packet_t *pkt) {
     }
 
     server_packet_t response;
-    if (recv(client_fd, &response, sizeof(server_packet_t), 0) <= 0) {
+    if (recv_reply(&response) < 0) {
         log_err("recv failed after sending packet");
         return -1;
     }
@@ -189,10 +537,15 @@ int send_packet(client_packet_t *pkt) {
     return (response.packet_type == ACK) ? 0 : -1;
 }
 
+int has_packet_waiting() {
+    int size = proto_frame_size(rx_buf, rx_len);
+    return size > 0 && (size_t)size <= rx_len;
+}
+
 int recv_packet(server_packet_t *pkt) {
     if (!pkt || client_fd < 0) return -1;
 
-    if (recv(client_fd, pkt, sizeof(server_packet_t), 0) <= 0) {
+    if (recv_frame(pkt) < 0) {
         log_err("recv failed in recv_packet");
         return -1;
     }
@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#include "poker_equity.h"
+#include "hand_eval.h"
+#include "rng.h"
+
+#define CACHE_LINE 64
+#define MAX_UNKNOWN (MAX_PLAYERS * HOLE_CARDS + BOARD_CARDS)
+
+/**
+ * everything about a query that does not change between runouts. workers
+ * only read it.
+ */
+typedef struct {
+    int num_players;
+    card_t holes[MAX_PLAYERS][HOLE_CARDS];
+    cardset_t board;                    // known board cards
+    int board_missing;                  // board cards still to come
+    card_t *unknown[MAX_UNKNOWN];       // hole card slots to fill each runout
+    int num_unknown;
+    card_t live[DECK_SIZE];             // cards that are not known
+    int num_live;
+    hand_state_t hands[MAX_PLAYERS];    // known board plus hole cards (when all are known)
+} equity_plan_t;
+
+/**
+ * per thread tallies. each worker is aligned to its own cache lines so the
+ * threads never write to a shared line, and the results are only merged
+ * after every thread has been joined.
+ */
+typedef struct {
+    alignas(CACHE_LINE) const equity_plan_t *plan;
+    uint64_t runouts;
+    rng_t rng;
+    atomic_int *next_first;             // exact: the next first board card to claim
+    uint64_t wins[MAX_PLAYERS];
+    uint64_t ties[MAX_PLAYERS];
+    double shares[MAX_PLAYERS];
+} equity_worker_t;
+
+static int plan_query(const equity_query_t *q, equity_plan_t *plan) {
+    if (q->num_players < 2 || q->num_players > MAX_PLAYERS) {
+        return -1;
+    }
+
+    memset(plan, 0, sizeof *plan);
+    plan->num_players = q->num_players;
+    memcpy(plan->holes, q->holes, sizeof plan->holes);
+
+    cardset_t known = 0;
+    int num_known = 0;
+    for (int p = 0; p < q->num_players; ++p) {
+        for (int c = 0; c < HOLE_CARDS; ++c) {
+            card_t card = q->holes[p][c];
+            if (card == NOCARD) {
+                plan->unknown[plan->num_unknown++] = &plan->holes[p][c];
+                continue;
+            }
+            if (card < 0 || card >= DECK_SIZE) {
+                return -1;
+            }
+            known |= CARD_BIT(card);
+            ++num_known;
+        }
+    }
+    for (int c = 0; c < BOARD_CARDS; ++c) {
+        card_t card = q->board[c];
+        if (card == NOCARD) {
+            ++plan->board_missing;
+            continue;
+        }
+        if (card < 0 || card >= DECK_SIZE) {
+            return -1;
+        }
+        known |= CARD_BIT(card);
+        plan->board |= CARD_BIT(card);
+        ++num_known;
+    }
+    if (__builtin_popcountll(known) != num_known) {
+        return -1; // a card was given twice
+    }
+
+    for (card_t card = 0; card < DECK_SIZE; ++card) {
+        if (!(known & CARD_BIT(card))) {
+            plan->live[plan->num_live++] = card;
+        }
+    }
+
+    if (plan->num_unknown == 0) {
+        for (int p = 0; p < q->num_players; ++p) {
+            hand_state_clear(&plan->hands[p]);
+            for (int c = 0; c < BOARD_CARDS; ++c) {
+                if (q->board[c] != NOCARD) {
+                    hand_state_add(&plan->hands[p], q->board[c]);
+                }
+            }
+            hand_state_add(&plan->hands[p], q->holes[p][0]);
+            hand_state_add(&plan->hands[p], q->holes[p][1]);
+        }
+    }
+    return 0;
+}
+
+// credits one runout given every player's score
+static inline void tally_runout(equity_worker_t *w, const int *scores, int n) {
+    int best = -1;
+    int winners = 0;
+    for (int p = 0; p < n; ++p) {
+        if (scores[p] > best) {
+            best = scores[p];
+            winners = 1;
+        } else if (scores[p] == best) {
+            ++winners;
+        }
+    }
+
+    if (winners == 1) {
+        for (int p = 0; p < n; ++p) {
+            w->wins[p] += (scores[p] == best);
+        }
+        return;
+    }
+    double share = 1.0 / winners;
+    for (int p = 0; p < n; ++p) {
+        if (scores[p] == best) {
+            ++w->ties[p];
+            w->shares[p] += share;
+        }
+    }
+}
+
+static void *monte_carlo_worker(void *arg) {
+    equity_worker_t *w = arg;
+    const equity_plan_t *plan = w->plan;
+
+    // private copies: the hole slots are refilled and the deck reshuffled each runout
+    card_t holes[MAX_PLAYERS][HOLE_CARDS];
+    card_t *unknown[MAX_UNKNOWN];
+    card_t live[DECK_SIZE];
+    memcpy(holes, plan->holes, sizeof holes);
+    memcpy(live, plan->live, sizeof live);
+    for (int i = 0; i < plan->num_unknown; ++i) {
+        unknown[i] = &holes[0][0] + (plan->unknown[i] - &plan->holes[0][0]);
+    }
+
+    int n = plan->num_players;
+    int draws = plan->num_unknown + plan->board_missing;
+    int scores[MAX_PLAYERS];
+
+    for (uint64_t r = 0; r < w->runouts; ++r) {
+        // partial fisher-yates: live[0..draws) becomes a uniform random sample
+        for (int i = 0; i < draws; ++i) {
+            int j = i + rng_below(&w->rng, plan->num_live - i);
+            card_t tmp = live[i];
+            live[i] = live[j];
+            live[j] = tmp;
+        }
+
+        int d = 0;
+        for (int i = 0; i < plan->num_unknown; ++i) {
+            *unknown[i] = live[d++];
+        }
+        cardset_t board = plan->board;
+        for (; d < draws; ++d) {
+            board |= CARD_BIT(live[d]);
+        }
+
+        for (int p = 0; p < n; ++p) {
+            scores[p] = hand_eval_set(board | CARD_BIT(holes[p][0]) | CARD_BIT(holes[p][1]));
+        }
+        tally_runout(w, scores, n);
+    }
+    return NULL;
+}
+
+/**
+ * walks every way to finish the board from live[start..], `left` cards at a
+ * time. each player's hand state already holds the board so far, so a card is
+ * added to every hand once per partial board and shared by all the runouts
+ * below it.
+ */
+static void enumerate_board(equity_worker_t *w, const hand_state_t *hands, int start, int left) {
+    const equity_plan_t *plan = w->plan;
+    int n = plan->num_players;
+
+    if (left == 0) {
+        int scores[MAX_PLAYERS];
+        for (int p = 0; p < n; ++p) {
+            scores[p] = hand_eval_state(&hands[p]);
+        }
+        tally_runout(w, scores, n);
+        ++w->runouts;
+        return;
+    }
+
+    hand_state_t next[MAX_PLAYERS];
+    for (int i = start; i <= plan->num_live - left; ++i) {
+        card_t card = plan->live[i];
+        for (int p = 0; p < n; ++p) {
+            next[p] = hands[p];
+            hand_state_add(&next[p], card);
+        }
+        enumerate_board(w, next, i + 1, left - 1);
+    }
+}
+
+static void *exact_worker(void *arg) {
+    equity_worker_t *w = arg;
+    const equity_plan_t *plan = w->plan;
+    int n = plan->num_players;
+    int left = plan->board_missing;
+
+    if (left == 0) {
+        // nothing to deal, a single runout that the first claimer scores
+        if (atomic_fetch_add(w->next_first, 1) == 0) {
+            enumerate_board(w, plan->hands, 0, 0);
+        }
+        return NULL;
+    }
+
+    // workers claim first cards until none are left; the deeper the first
+    // card, the fewer boards follow it, so claiming keeps the threads balanced
+    hand_state_t hands[MAX_PLAYERS];
+    int first;
+    while ((first = atomic_fetch_add(w->next_first, 1)) <= plan->num_live - left) {
+        for (int p = 0; p < n; ++p) {
+            hands[p] = plan->hands[p];
+            hand_state_add(&hands[p], plan->live[first]);
+        }
+        enumerate_board(w, hands, first + 1, left - 1);
+    }
+    return NULL;
+}
+
+static int default_threads(int threads) {
+    if (threads > 0) {
+        return threads;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cpus > 0) ? (int)cpus : 1;
+}
+
+static void merge_workers(const equity_worker_t *workers, int threads, int n, equity_result_t *out) {
+    memset(out, 0, sizeof *out);
+
+    uint64_t wins[MAX_PLAYERS] = {0};
+    uint64_t ties[MAX_PLAYERS] = {0};
+    double shares[MAX_PLAYERS] = {0};
+    for (int t = 0; t < threads; ++t) {
+        out->runouts += workers[t].runouts;
+        for (int p = 0; p < n; ++p) {
+            wins[p] += workers[t].wins[p];
+            ties[p] += workers[t].ties[p];
+            shares[p] += workers[t].shares[p];
+        }
+    }
+
+    if (out->runouts == 0) {
+        return;
+    }
+    for (int p = 0; p < n; ++p) {
+        out->win[p] = (double)wins[p] / out->runouts;
+        out->tie[p] = (double)ties[p] / out->runouts;
+        out->equity[p] = (wins[p] + shares[p]) / out->runouts;
+    }
+}
+
+// runs fn over every worker, the calling thread taking the first one itself
+static void run_workers(equity_worker_t *workers, pthread_t *tids, int threads, void *(*fn)(void *)) {
+    int started = 1;
+    for (int t = 1; t < threads; ++t, ++started) {
+        if (pthread_create(&tids[t], NULL, fn, &workers[t]) != 0) {
+            break;
+        }
+    }
+    // anything that could not get a thread is run here instead
+    for (int t = started; t < threads; ++t) {
+        fn(&workers[t]);
+    }
+    fn(&workers[0]);
+    for (int t = 1; t < started; ++t) {
+        pthread_join(tids[t], NULL);
+    }
+}
+
+int equity_monte_carlo(const equity_query_t *q, uint64_t runouts, int threads, uint64_t seed, equity_result_t *out) {
+    equity_plan_t plan;
+    if (plan_query(q, &plan) < 0) {
+        return -1;
+    }
+    hand_eval_init();
+
+    threads = default_threads(threads);
+    if ((uint64_t)threads > runouts) {
+        threads = runouts ? (int)runouts : 1;
+    }
+
+    equity_worker_t *workers = aligned_alloc(CACHE_LINE, threads * sizeof *workers);
+    pthread_t *tids = malloc(threads * sizeof *tids);
+    if (!workers || !tids) {
+        free(workers);
+        free(tids);
+        return -1;
+    }
+
+    memset(workers, 0, threads * sizeof *workers);
+    for (int t = 0; t < threads; ++t) {
+        workers[t].plan = &plan;
+        workers[t].runouts = runouts / threads + ((uint64_t)t < runouts % threads);
+        rng_init(&workers[t].rng, seed, t);
+    }
+
+    run_workers(workers, tids, threads, monte_carlo_worker);
+    merge_workers(workers, threads, plan.num_players, out);
+
+    free(workers);
+    free(tids);
+    return 0;
+}
+
+int equity_exact(const equity_query_t *q, int threads, equity_result_t *out) {
+    equity_plan_t plan;
+    if (plan_query(q, &plan) < 0 || plan.num_unknown > 0) {
+        return -1;
+    }
+    hand_eval_init();
+
+    threads = default_threads(threads);
+    equity_worker_t *workers = aligned_alloc(CACHE_LINE, threads * sizeof *workers);
+    pthread_t *tids = malloc(threads * sizeof *tids);
+    if (!workers || !tids) {
+        free(workers);
+        free(tids);
+        return -1;
+    }
+
+    atomic_int next_first = 0;
+    memset(workers, 0, threads * sizeof *workers);
+    for (int t = 0; t < threads; ++t) {
+        workers[t].plan = &plan;
+        workers[t].next_first = &next_first;
+    }
+
+    run_workers(workers, tids, threads, exact_worker);
+    merge_workers(workers, threads, plan.num_players, out);
+
+    free(workers);
+    free(tids);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * all-in equity calculator
+ *
+ * usage:
+ *  equity.poker_equity [-e] [-n runouts] [-j threads] [-s seed] [-b board] HAND HAND [HAND...]
+ *
+ *  HAND    the two hole cards of a player, e.g. AsKd, or ?? for a random hand
+ *  -b      the known board cards, e.g. Ah7c2d
+ *  -e      walk every runout for an exact answer instead of sampling
+ *  -n      how many runouts to sample (default 1000000)
+ *  -j      worker threads (default one per cpu)
+ *  -s      seed of the random streams (default 0)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "poker_equity.h"
+#include "utility.h"
+
+#define DEFAULT_RUNOUTS 1000000
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-e] [-n runouts] [-j threads] [-s seed] [-b board] HAND HAND [HAND...]\n", prog);
+}
+
+// parses up to max cards written back to back (e.g. "AsKd"), ?? is NOCARD
+static int parse_cards(const char *str, card_t *out, int max)
+{
+    size_t len = strlen(str);
+    if (len % 2 || (int)(len / 2) > max) return -1;
+
+    for (size_t i = 0; i < len; i += 2)
+    {
+        char buf[3] = { str[i], str[i + 1], '\0' };
+        if (strcmp(buf, "??") == 0)
+        {
+            out[i / 2] = NOCARD;
+            continue;
+        }
+        out[i / 2] = card_id(buf);
+        if (out[i / 2] == NOCARD) return -1;
+    }
+    return (int)(len / 2);
+}
+
+int main(int argc, char *argv[])
+{
+    equity_query_t q;
+    memset(&q, NOCARD, sizeof q);
+    q.num_players = 0;
+
+    unsigned long long runouts = DEFAULT_RUNOUTS;
+    unsigned long long seed = 0;
+    int threads = 0;
+    int exact = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "en:j:s:b:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'e':
+            exact = 1;
+            break;
+        case 'n':
+            runouts = strtoull(optarg, NULL, 10);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'b':
+            if (parse_cards(optarg, q.board, BOARD_CARDS) < 0)
+            {
+                fprintf(stderr, "invalid board: %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    for (int i = optind; i < argc; ++i)
+    {
+        if (q.num_players == MAX_PLAYERS)
+        {
+            fprintf(stderr, "at most %d hands are supported\n", MAX_PLAYERS);
+            return 1;
+        }
+        // a lone ?? stands for a whole random hand
+        const char *hand = strcmp(argv[i], "??") == 0 ? "????" : argv[i];
+        if (parse_cards(hand, q.holes[q.num_players], HOLE_CARDS) != HOLE_CARDS)
+        {
+            fprintf(stderr, "invalid hand: %s\n", argv[i]);
+            return 1;
+        }
+        ++q.num_players;
+    }
+    if (q.num_players < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct timespec start, end;
+    equity_result_t res;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ret = exact ? equity_exact(&q, threads, &res)
+                    : equity_monte_carlo(&q, runouts, threads, seed, &res);
+    if (ret < 0)
+    {
+        fprintf(stderr, exact ? "invalid query (is a card used twice or a hand unknown?)\n"
+                              : "invalid query (is a card used twice?)\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("runouts: %llu in %.3fs (%.2fM/s)\n", (unsigned long long)res.runouts, secs,
+           secs > 0 ? res.runouts / secs / 1e6 : 0.0);
+
+    for (int p = 0; p < q.num_players; ++p)
+    {
+        printf("hand %d  %s%s  equity %6.2f%%  win %6.2f%%  tie %6.2f%%\n", p,
+               q.holes[p][0] == NOCARD ? "??" : card_name(q.holes[p][0]),
+               q.holes[p][1] == NOCARD ? "??" : card_name(q.holes[p][1]),
+               100 * res.equity[p], 100 * res.win[p], 100 * res.tie[p]);
+    }
+    return 0;
+}
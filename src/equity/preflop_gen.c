@@ -0,0 +1,101 @@
+/**
+ * builds the preflop equity table (see preflop_table.h)
+ *
+ * usage:
+ *  equity.preflop_gen [-n runouts] [-j threads] [-s seed] [OUTPUT]
+ *
+ *  OUTPUT  where to write the table (default PREFLOP_TABLE_PATH)
+ *  -n      runouts sampled for each class and opponent count (default 50000)
+ *  -j      worker threads (default one per cpu)
+ *  -s      seed of the random streams (default 0)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "poker_equity.h"
+#include "preflop_table.h"
+
+#define DEFAULT_RUNOUTS 50000
+
+int main(int argc, char *argv[])
+{
+    unsigned long long runouts = DEFAULT_RUNOUTS;
+    unsigned long long seed = 0;
+    int threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:j:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            runouts = strtoull(optarg, NULL, 10);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n runouts] [-j threads] [-s seed] [OUTPUT]\n", argv[0]);
+            return 1;
+        }
+    }
+    const char *path = (optind < argc) ? argv[optind] : PREFLOP_TABLE_PATH;
+
+    preflop_table_t table;
+    memset(&table, 0, sizeof table);
+    table.magic = PREFLOP_MAGIC;
+    table.version = PREFLOP_VERSION;
+    table.num_classes = PREFLOP_CLASSES;
+    table.max_opponents = PREFLOP_MAX_OPPONENTS;
+    table.runouts = runouts;
+
+    for (int row = 0; row < 13; ++row)
+    {
+        for (int col = 0; col < 13; ++col)
+        {
+            // [row][col] is suited below the diagonal and offsuit above it
+            int suited = row > col;
+            int high = row > col ? row : col;
+            int low = row > col ? col : row;
+            card_t c0 = (high << SUITE_BITS) | SPADE;
+            card_t c1 = (low << SUITE_BITS) | (suited ? SPADE : HEART);
+            int cls = preflop_class(c0, c1);
+
+            for (int opp = 1; opp <= PREFLOP_MAX_OPPONENTS; ++opp)
+            {
+                equity_query_t q;
+                memset(&q, NOCARD, sizeof q);
+                q.num_players = opp + 1;
+                q.holes[0][0] = c0;
+                q.holes[0][1] = c1;
+
+                equity_result_t res;
+                if (equity_monte_carlo(&q, runouts, threads, seed + cls * PREFLOP_MAX_OPPONENTS + opp, &res) < 0)
+                {
+                    fprintf(stderr, "failed to compute class %d\n", cls);
+                    return 1;
+                }
+                table.equity[cls][opp - 1] = (uint16_t)(res.equity[0] * 65535.0 + 0.5);
+            }
+        }
+        fprintf(stderr, "\rclasses done: %d/%d", (row + 1) * 13, PREFLOP_CLASSES);
+    }
+    fprintf(stderr, "\n");
+
+    FILE *out = fopen(path, "wb");
+    if (!out || fwrite(&table, sizeof table, 1, out) != 1)
+    {
+        fprintf(stderr, "failed to write %s\n", path);
+        if (out) fclose(out);
+        return 1;
+    }
+    fclose(out);
+    printf("wrote %s (%zu bytes)\n", path, sizeof table);
+    return 0;
+}
@@ -41,15 +41,19 @@ int handle_client_action(game_state_t *g, player_id_t pid, const client_packet_t
     switch (in->packet_type) {
         case CHECK: 
             return (to_call == 0) ? send_ack(out) : send_nack(out);
-        case CALL:
-            if (to_call <= 0 || to_call > g->player_stacks[pid]){
+        case CALL: {
+            if (to_call <= 0) {
                 return send_nack(out);
             }
-            g->player_stacks[pid] -= to_call;
-            g->current_bets [pid] += to_call;
-            g->pot_size += to_call;
+            // a player who cannot cover the bet calls all in, for what they have
+            const int chips = to_call < g->player_stacks[pid] ? to_call : g->player_stacks[pid];
+            g->player_stacks[pid] -= chips;
+            g->current_bets [pid] += chips;
+            g->contributions[pid] += chips;
+            g->pot_size += chips;
             maybe_allin(g, pid);
             return send_ack(out);
+        }
 
         case RAISE: {
             const int chips_now = in->params[0];
@@ -59,6 +63,7 @@ int handle_client_action(game_state_t *g, player_id_t pid, const client_packet_t
             }
             g->player_stacks[pid] -= chips_now;
             g->current_bets [pid] += chips_now;
+            g->contributions[pid] += chips_now;
             g->pot_size += chips_now;
 
             g->highest_bet = g->current_bets[pid];
@@ -87,10 +92,15 @@ static void card_to_string(card_t c, char *buf)
 void build_info_packet(game_state_t *g, player_id_t pid, server_packet_t *out)
 {
     out->packet_type = INFO;
-    info_packet_t *info = &out->info;
+    build_public_info(g, &out->info);
+    out->info.player_cards[0] = g->player_hands[pid][0];
+    out->info.player_cards[1] = g->player_hands[pid][1];
+}
 
-    info->player_cards[0] = g->player_hands[pid][0];
-    info->player_cards[1] = g->player_hands[pid][1];
+void build_public_info(game_state_t *g, info_packet_t *info)
+{
+    info->player_cards[0] = NOCARD;
+    info->player_cards[1] = NOCARD;
 
     for (int k = 0; k < MAX_COMMUNITY_CARDS; ++k)
         info->community_cards[k] = NOCARD;
@@ -135,4 +145,8 @@ void build_end_packet(game_state_t *g, player_id_t winner, server_packet_t *out)
     e->pot_size = g->pot_size;
     e->dealer = g->dealer_player;
     e->winner = winner;
+
+    e->num_pots = g->num_pots;
+    memset(e->pots, 0, sizeof e->pots);
+    memcpy(e->pots, g->pots, g->num_pots * sizeof(pot_result_t));
 }
\ No newline at end of file
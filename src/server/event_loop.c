@@ -0,0 +1,870 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "event_loop.h"
+#include "uring.h"
+
+#define MAX_EVENTS 64
+#define SEND_IOVS 16                    // segments one sendmsg() gathers, wbuf's two and then frames
+
+// what an io_uring request was for, kept in the low bits of its user_data
+#define UD_RECV   1
+#define UD_SEND   2
+#define UD_ACCEPT 3
+#define UD_NOTIFY 4
+#define UD_CANCEL 5
+#define UD_MASK   7
+
+static uint64_t clock_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t ud(conn_t *c, int op)
+{
+    return (uint64_t)(uintptr_t)c | op;
+}
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int in_pool(event_loop_t *loop, conn_t *c)
+{
+    return loop->pool && c >= loop->pool && c < loop->pool + LOOP_URING_CONNS;
+}
+
+static conn_t *new_conn(event_loop_t *loop, int fd, conn_kind_t kind)
+{
+    conn_t *c;
+    if (loop->pool && kind == CONN_STREAM) {
+        c = loop->free_conns;
+        if (!c) return NULL;
+        loop->free_conns = c->next_closed;
+        memset(c, 0, offsetof(conn_t, rbuf));
+    } else {
+        c = calloc(1, sizeof *c);
+        if (!c) return NULL;
+    }
+    c->fd = fd;
+    c->kind = kind;
+    c->seat = -1;
+    return c;
+}
+
+// drops whatever frames are still queued, only once no send request points into them
+static void drop_frames(conn_t *c)
+{
+    for (; c->frame_cnt > 0; --c->frame_cnt) {
+        frame_put(c->frames[c->frame_head]);
+        c->frame_head = (c->frame_head + 1) % CONN_FRAMES;
+    }
+    c->frame_off = 0;
+}
+
+static void free_conn(event_loop_t *loop, conn_t *c)
+{
+    drop_frames(c);
+    if (in_pool(loop, c)) {
+        c->next_closed = loop->free_conns;
+        loop->free_conns = c;
+    } else {
+        free(c);
+    }
+}
+
+// the file a request on c names: its fixed file slot, or its descriptor
+static int io_file(event_loop_t *loop, conn_t *c)
+{
+    return loop->fixed_files ? (int)(c - loop->pool) : c->fd;
+}
+
+static void post_recv(event_loop_t *loop, conn_t *c)
+{
+    if (c->fd < 0 || c->eof || c->receiving) return;
+    if (c->shm) {
+        // the socket only carries doorbells, input never waits on room in rbuf
+        c->receiving = 1;
+        ++c->inflight;
+        uring_recv(loop->uring, io_file(loop, c), loop->fixed_files, c->bell, sizeof c->bell, ud(c, UD_RECV));
+        return;
+    }
+    if (c->rlen >= CONN_BUFFER_SIZE) return;
+    c->receiving = 1;
+    ++c->inflight;
+    c->recv_off = c->rlen;
+    if (loop->fixed_buffers) {
+        uring_read_fixed(loop->uring, io_file(loop, c), loop->fixed_files, c->rbuf + c->rlen, CONN_BUFFER_SIZE - c->rlen, ud(c, UD_RECV));
+    } else {
+        uring_recv(loop->uring, io_file(loop, c), loop->fixed_files, c->rbuf + c->rlen, CONN_BUFFER_SIZE - c->rlen, ud(c, UD_RECV));
+    }
+}
+
+// the unsent output that is contiguous in wbuf
+static size_t send_chunk(conn_t *c)
+{
+    size_t to_end = CONN_BUFFER_SIZE - c->woff;
+    return c->wlen < to_end ? c->wlen : to_end;
+}
+
+static int unsent(conn_t *c)
+{
+    return c->wlen > 0 || c->frame_cnt > 0;
+}
+
+// the next contiguous piece of output: wbuf up to its end, or what is left of the first frame
+static const unsigned char *out_chunk(conn_t *c, size_t *len)
+{
+    if (c->wlen > 0) {
+        *len = send_chunk(c);
+        return c->wbuf + c->woff;
+    }
+    shared_frame_t *f = c->frames[c->frame_head];
+    *len = f->len - c->frame_off;
+    return f->data + c->frame_off;
+}
+
+// n bytes of output have been sent, wbuf's first and then the frames'
+static void sent(conn_t *c, size_t n)
+{
+    size_t k = n < c->wlen ? n : c->wlen;
+    c->woff = (c->woff + k) % CONN_BUFFER_SIZE;
+    c->wlen -= k;
+    n -= k;
+    while (n > 0) {
+        shared_frame_t *f = c->frames[c->frame_head];
+        k = f->len - c->frame_off < n ? f->len - c->frame_off : n;
+        c->frame_off += k;
+        n -= k;
+        if (c->frame_off < f->len) break;
+        frame_put(f);
+        c->frame_head = (c->frame_head + 1) % CONN_FRAMES;
+        --c->frame_cnt;
+        c->frame_off = 0;
+    }
+}
+
+// a send only covers one chunk of the output, the next one picks up the rest
+static void post_send(event_loop_t *loop, conn_t *c)
+{
+    if (c->fd < 0 || c->sending || !unsent(c)) return;
+    c->sending = 1;
+    ++c->inflight;
+    size_t len;
+    const unsigned char *chunk = out_chunk(c, &len);
+    // frames live outside the registered pool
+    if (loop->fixed_buffers && c->wlen > 0) {
+        uring_write_fixed(loop->uring, io_file(loop, c), loop->fixed_files, chunk, len, ud(c, UD_SEND));
+    } else {
+        uring_send(loop->uring, io_file(loop, c), loop->fixed_files, chunk, len, ud(c, UD_SEND));
+    }
+}
+
+static void ring_bell(conn_t *c)
+{
+    // a full socket already holds doorbells the client has yet to read
+    unsigned char bell = 0;
+    ssize_t n = send(c->fd, &bell, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    (void)n;
+}
+
+// moves whatever fits of the client's input from its ring to rbuf, the caller
+// hands it to on_data: input nobody is told about would wait there for good
+static void pull_shm(conn_t *c)
+{
+    size_t n = shm_ring_read(&c->shm->up, c->rbuf + c->rlen, CONN_BUFFER_SIZE - c->rlen);
+    c->rlen += n;
+    if (n > 0 && shm_ring_writer_parked(&c->shm->up)) ring_bell(c);
+}
+
+// reads while the buffer has room, writes only while something is queued.
+// a channel's input is left in its ring, park_shm finds it before the loop sleeps
+static void update_events(event_loop_t *loop, conn_t *c)
+{
+    if (loop->uring) {
+        post_recv(loop, c);
+        return;
+    }
+
+    // doorbells are read whatever rbuf holds, and output never waits on the socket
+    uint32_t want = 0;
+    if (!c->eof && (c->shm || c->rlen < CONN_BUFFER_SIZE)) want |= EPOLLIN;
+    if (unsent(c) && !c->shm) want |= EPOLLOUT;
+    if (want == c->events) return;
+
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    epoll_ctl(loop->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = want;
+}
+
+// stops watching a socket, io_uring requests still posted on it are cancelled
+static void unwatch(event_loop_t *loop, conn_t *c)
+{
+    if (!loop->uring) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        return;
+    }
+    if (c->receiving) uring_cancel(loop->uring, ud(c, UD_RECV), ud(c, UD_CANCEL));
+    if (c->sending) uring_cancel(loop->uring, ud(c, UD_SEND), ud(c, UD_CANCEL));
+    if (c->kind == CONN_LISTENER) uring_cancel(loop->uring, ud(c, UD_ACCEPT), ud(c, UD_CANCEL));
+    if (c->kind == CONN_NOTIFY) uring_cancel(loop->uring, ud(c, UD_NOTIFY), ud(c, UD_CANCEL));
+    if (loop->fixed_files && in_pool(loop, c)) uring_set_file(loop->uring, c - loop->pool, -1);
+}
+
+static void bury(event_loop_t *loop, conn_t *c)
+{
+    c->fd = -1;
+    c->next_closed = loop->graveyard;
+    loop->graveyard = c;
+}
+
+// takes a connection off the loop's shm list. its own links are left alone,
+// so a walk over the list that is standing on it can still move on
+static void unlink_shm(event_loop_t *loop, conn_t *c)
+{
+    if (c->prev_shm) c->prev_shm->next_shm = c->next_shm;
+    else loop->shm_conns = c->next_shm;
+    if (c->next_shm) c->next_shm->prev_shm = c->prev_shm;
+}
+
+static void close_now(event_loop_t *loop, conn_t *c)
+{
+    if (c->fd < 0) return;
+    if (loop->ops->on_close) loop->ops->on_close(loop, c);
+    if (c->shm) {
+        unlink_shm(loop, c);
+        shm_channel_close(c->shm);
+        c->shm = NULL;
+    }
+    unwatch(loop, c);
+    close(c->fd);
+    --loop->num_conns;
+    if (c->closing) --loop->num_closing;
+    bury(loop, c);
+}
+
+// what is left after a send, closing the connection if that was all it waited for
+static void after_send(event_loop_t *loop, conn_t *c)
+{
+    if (c->wlen == 0) c->woff = 0;
+
+    if (c->closing && !unsent(c)) {
+        close_now(loop, c);
+        return;
+    }
+    update_events(loop, c);
+}
+
+// tells the owner a congested connection has caught up. never called from
+// inside conn_write, so the owner is not re-entered while it is sending
+static void check_drain(event_loop_t *loop, conn_t *c)
+{
+    if (c->fd >= 0 && c->congested && c->wlen < CONN_WBUF_LOW) {
+        c->congested = 0;
+        if (loop->ops->on_drain) loop->ops->on_drain(loop, c);
+    }
+}
+
+// copies output into the client's ring, as much as it has room for
+static void flush_shm(event_loop_t *loop, conn_t *c)
+{
+    shm_ring_t *r = &c->shm->down;
+    size_t total = 0;
+    while (unsent(c)) {
+        size_t len;
+        const unsigned char *chunk = out_chunk(c, &len);
+        size_t n = shm_ring_write(r, chunk, len);
+        if (n > 0) {
+            sent(c, n);
+            total += n;
+            continue;
+        }
+        // full, the client rings once it has made room
+        if (shm_ring_park_writer(r)) break;
+    }
+    if (total > 0 && shm_ring_reader_parked(r)) ring_bell(c);
+    after_send(loop, c);
+}
+
+static void flush_conn(event_loop_t *loop, conn_t *c)
+{
+    if (c->fd < 0) return;
+    if (c->shm) {
+        flush_shm(loop, c);
+        return;
+    }
+    if (loop->uring) {
+        post_send(loop, c);
+        return;
+    }
+
+    while (unsent(c)) {
+        // output that wraps around the end of wbuf goes out in the same call, as do queued frames
+        struct iovec iov[SEND_IOVS];
+        int cnt = 0;
+        if (c->wlen > 0) {
+            iov[cnt++] = (struct iovec){ .iov_base = c->wbuf + c->woff, .iov_len = send_chunk(c) };
+            if (c->wlen > send_chunk(c)) iov[cnt++] = (struct iovec){ .iov_base = c->wbuf, .iov_len = c->wlen - send_chunk(c) };
+        }
+        for (int i = 0; i < c->frame_cnt && cnt < SEND_IOVS; ++i) {
+            shared_frame_t *f = c->frames[(c->frame_head + i) % CONN_FRAMES];
+            size_t off = i == 0 ? c->frame_off : 0;
+            iov[cnt++] = (struct iovec){ .iov_base = f->data + off, .iov_len = f->len - off };
+        }
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = cnt };
+        ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent(c, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0 && errno == EINTR) continue;
+
+        // the peer is gone, nothing queued for it can be delivered
+        c->eof = 1;
+        c->woff = c->wlen = 0;
+        drop_frames(c);
+        break;
+    }
+    after_send(loop, c);
+}
+
+// the client rang, or the loop found input in its ring: there may be input
+// to read, or room for the output still waiting
+static void serve_shm(event_loop_t *loop, conn_t *c)
+{
+    pull_shm(c);
+    if (loop->ops->on_data) loop->ops->on_data(loop, c);
+    if (c->fd >= 0 && c->shm && unsent(c)) {
+        flush_conn(loop, c);
+        check_drain(loop, c);
+    }
+}
+
+static void read_bells(event_loop_t *loop, conn_t *c)
+{
+    while (1) {
+        ssize_t n = recv(c->fd, c->bell, sizeof c->bell, 0);
+        if (n > 0) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0 && errno == EINTR) continue;
+        c->eof = 1;
+        break;
+    }
+    serve_shm(loop, c);
+    if (c->fd >= 0) update_events(loop, c);
+}
+
+// before the loop sleeps: park every channel, so that its client rings from
+// now on. returns 1 if one of them had input after all and sleeping must wait
+static int park_shm(event_loop_t *loop)
+{
+    int busy = 0;
+    for (conn_t *c = loop->shm_conns; c; c = c->next_shm) {
+        if (c->rlen < CONN_BUFFER_SIZE && !shm_ring_park_reader(&c->shm->up)) busy = 1;
+    }
+    return busy;
+}
+
+// after the wait: read the channels without doorbells again, and serve the
+// ones that have input. a connection closed meanwhile is skipped, it is only
+// freed at the end of the iteration. with io_uring a doorbell receive may
+// still be posted while on_data runs, which only risks a doorbell if the
+// connection is handed off: the new loop looks at the ring before it sleeps
+static void unpark_shm(event_loop_t *loop)
+{
+    conn_t *next;
+    for (conn_t *c = loop->shm_conns; c; c = next) {
+        next = c->next_shm;
+        if (c->fd < 0 || !c->shm) continue;
+        shm_ring_unpark_reader(&c->shm->up);
+        if (c->rlen < CONN_BUFFER_SIZE && shm_ring_used(&c->shm->up) > 0) serve_shm(loop, c);
+    }
+}
+
+static void read_conn(event_loop_t *loop, conn_t *c)
+{
+    if (c->shm) {
+        read_bells(loop, c);
+        return;
+    }
+    while (c->rlen < CONN_BUFFER_SIZE) {
+        ssize_t n = recv(c->fd, c->rbuf + c->rlen, CONN_BUFFER_SIZE - c->rlen, 0);
+        if (n > 0) {
+            c->rlen += n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0 && errno == EINTR) continue;
+        c->eof = 1;
+        break;
+    }
+    update_events(loop, c);
+    if (loop->ops->on_data) loop->ops->on_data(loop, c);
+}
+
+// registers a connected socket, closing it on failure. the caller starts reading with update_events
+static conn_t *add_stream(event_loop_t *loop, int fd)
+{
+    conn_t *c = new_conn(loop, fd, CONN_STREAM);
+    if (!c) {
+        close(fd);
+        return NULL;
+    }
+
+    if (loop->uring) {
+        // io_uring waits for the socket itself, it must stay blocking
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags >= 0) fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+        if (loop->fixed_files && uring_set_file(loop->uring, c - loop->pool, fd) < 0) {
+            free_conn(loop, c);
+            close(fd);
+            return NULL;
+        }
+        ++loop->num_conns;
+        return c;
+    }
+
+    if (set_nonblocking(fd) < 0) {
+        free_conn(loop, c);
+        close(fd);
+        return NULL;
+    }
+    c->events = EPOLLIN;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        free_conn(loop, c);
+        close(fd);
+        return NULL;
+    }
+    ++loop->num_conns;
+    return c;
+}
+
+static void accepted(event_loop_t *loop, conn_t *listener, int fd)
+{
+    conn_t *c = add_stream(loop, fd);
+    if (!c) return;
+    c->tag = listener->tag;
+    update_events(loop, c);
+    if (loop->ops->on_accept) loop->ops->on_accept(loop, listener, c);
+}
+
+static void accept_conns(event_loop_t *loop, conn_t *listener)
+{
+    while (1) {
+        int fd = accept(listener->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        accepted(loop, listener, fd);
+    }
+}
+
+static void drain_notify(event_loop_t *loop, conn_t *n)
+{
+    uint64_t count;
+    while (read(n->fd, &count, sizeof count) > 0) {
+    }
+    if (loop->ops->on_notify) loop->ops->on_notify(loop, n);
+}
+
+// watches a listener or notifier, which only ever wait to be readable
+static int watch(event_loop_t *loop, conn_t *c)
+{
+    if (loop->uring) {
+        ++c->inflight;
+        if (c->kind == CONN_LISTENER) uring_accept(loop->uring, c->fd, ud(c, UD_ACCEPT));
+        else uring_read(loop->uring, c->fd, c->rbuf, sizeof(uint64_t), ud(c, UD_NOTIFY));
+        return 0;
+    }
+    c->events = EPOLLIN;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static int init_uring(event_loop_t *loop)
+{
+    loop->uring = uring_open(MAX_EVENTS * 4);
+    if (!loop->uring) return -1;
+
+    loop->pool = calloc(LOOP_URING_CONNS, sizeof(conn_t));
+    if (!loop->pool) {
+        uring_close(loop->uring);
+        loop->uring = NULL;
+        return -1;
+    }
+    for (int i = LOOP_URING_CONNS - 1; i >= 0; --i) {
+        loop->pool[i].next_closed = loop->free_conns;
+        loop->free_conns = &loop->pool[i];
+    }
+
+    // both are optimisations, the ring works without them
+    loop->fixed_files = uring_register_files(loop->uring, LOOP_URING_CONNS) == 0;
+    loop->fixed_buffers = uring_register_buffer(loop->uring, loop->pool, LOOP_URING_CONNS * sizeof(conn_t)) == 0;
+    return 0;
+}
+
+int loop_init(event_loop_t *loop, const loop_ops_t *ops, void *ctx, loop_backend_t backend)
+{
+    memset(loop, 0, sizeof *loop);
+    loop->ops = ops;
+    loop->ctx = ctx;
+    loop->epfd = -1;
+    loop->now_ms = clock_ms();
+    tw_init(&loop->timers, loop->now_ms);
+
+    if (backend == LOOP_IO_URING && init_uring(loop) == 0) {
+        loop->backend = LOOP_IO_URING;
+        return 0;
+    }
+    loop->backend = LOOP_EPOLL;
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    return loop->epfd < 0 ? -1 : 0;
+}
+
+conn_t *loop_listen(event_loop_t *loop, int fd, int tag)
+{
+    if (!loop->uring && set_nonblocking(fd) < 0) return NULL;
+    conn_t *l = new_conn(loop, fd, CONN_LISTENER);
+    if (!l) return NULL;
+    l->tag = tag;
+    if (watch(loop, l) < 0) {
+        free(l);
+        return NULL;
+    }
+    return l;
+}
+
+void loop_unlisten(event_loop_t *loop, conn_t *listener)
+{
+    if (listener->fd < 0) return;
+    unwatch(loop, listener);
+    close(listener->fd);
+    bury(loop, listener);
+}
+
+conn_t *loop_notifier(event_loop_t *loop)
+{
+    int fd = eventfd(0, EFD_CLOEXEC | (loop->uring ? 0 : EFD_NONBLOCK));
+    if (fd < 0) return NULL;
+    conn_t *n = new_conn(loop, fd, CONN_NOTIFY);
+    if (!n) {
+        close(fd);
+        return NULL;
+    }
+    if (watch(loop, n) < 0) {
+        close(fd);
+        free(n);
+        return NULL;
+    }
+    return n;
+}
+
+void loop_notify(conn_t *notify)
+{
+    uint64_t one = 1;
+    ssize_t n = write(notify->fd, &one, sizeof one);
+    (void)n;
+}
+
+int loop_release(event_loop_t *loop, conn_t *c)
+{
+    int fd = c->fd;
+    if (fd < 0) return -1;
+    if (c->shm) unlink_shm(loop, c);
+    unwatch(loop, c);
+    --loop->num_conns;
+    if (c->closing) --loop->num_closing;
+    bury(loop, c);
+    return fd;
+}
+
+static void add_shm(event_loop_t *loop, conn_t *c, shm_channel_t *shm)
+{
+    c->shm = shm;
+    c->prev_shm = NULL;
+    c->next_shm = loop->shm_conns;
+    if (loop->shm_conns) loop->shm_conns->prev_shm = c;
+    loop->shm_conns = c;
+}
+
+conn_t *loop_adopt(event_loop_t *loop, int fd, const void *buf, size_t len, shm_channel_t *shm)
+{
+    conn_t *c = add_stream(loop, fd);
+    if (!c) {
+        if (shm) shm_channel_close(shm);
+        return NULL;
+    }
+    if (len > CONN_BUFFER_SIZE) len = CONN_BUFFER_SIZE;
+    memcpy(c->rbuf, buf, len);
+    c->rlen = len;
+    if (shm) add_shm(loop, c, shm);
+    update_events(loop, c);
+    return c;
+}
+
+void conn_attach_shm(event_loop_t *loop, conn_t *c, shm_channel_t *shm)
+{
+    add_shm(loop, c, shm);
+    // the client writes nothing to the channel before this doorbell says it is mapped
+    ring_bell(c);
+    update_events(loop, c);
+}
+
+static void on_completion(event_loop_t *loop, const uring_cqe_t *cqe)
+{
+    conn_t *c = (conn_t *)(uintptr_t)(cqe->user_data & ~(uint64_t)UD_MASK);
+    int op = cqe->user_data & UD_MASK;
+    if (op == UD_CANCEL) return;
+
+    --c->inflight;
+    if (op == UD_RECV) c->receiving = 0;
+    if (op == UD_SEND) c->sending = 0;
+    if (c->fd < 0) {
+        // closed while the request was posted, the last one out frees it
+        if (c->inflight == 0 && c->buried) free_conn(loop, c);
+        return;
+    }
+
+    switch (op) {
+        case UD_ACCEPT:
+            if (cqe->res >= 0) accepted(loop, c, cqe->res);
+            watch(loop, c);
+            break;
+
+        case UD_NOTIFY:
+            if (loop->ops->on_notify) loop->ops->on_notify(loop, c);
+            watch(loop, c);
+            break;
+
+        case UD_RECV:
+            if (c->shm) {
+                if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -EAGAIN && cqe->res != -EINTR)) c->eof = 1;
+                // a doorbell, the input itself is in the ring
+                serve_shm(loop, c);
+                if (c->fd >= 0) update_events(loop, c);
+                break;
+            }
+            if (cqe->res > 0) {
+                // input was consumed while the receive was posted, close the gap
+                if (c->recv_off != c->rlen) memmove(c->rbuf + c->rlen, c->rbuf + c->recv_off, cqe->res);
+                c->rlen += cqe->res;
+            } else if (cqe->res != -EAGAIN && cqe->res != -EINTR) {
+                c->eof = 1;
+            }
+            // nothing may be posted on c while on_data runs, it might hand c to another loop
+            if (loop->ops->on_data) loop->ops->on_data(loop, c);
+            if (c->fd >= 0) update_events(loop, c);
+            break;
+
+        case UD_SEND:
+            if (cqe->res > 0) {
+                sent(c, cqe->res);
+            } else if (cqe->res != -EAGAIN && cqe->res != -EINTR) {
+                c->eof = 1;
+                c->woff = c->wlen = 0;
+                drop_frames(c);
+            }
+            after_send(loop, c);
+            check_drain(loop, c);
+            if (c->fd >= 0) post_send(loop, c);
+            break;
+    }
+}
+
+void loop_run_once(event_loop_t *loop, int timeout_ms)
+{
+    int64_t next_timer = tw_next_timeout(&loop->timers, clock_ms());
+    if (next_timer >= 0 && (timeout_ms < 0 || next_timer < timeout_ms)) timeout_ms = (int)next_timer;
+    if (park_shm(loop)) timeout_ms = 0;
+
+    if (loop->uring) {
+        uring_cqe_t cqes[MAX_EVENTS];
+        int n = uring_wait(loop->uring, cqes, MAX_EVENTS, timeout_ms);
+        loop->now_ms = clock_ms();
+        unpark_shm(loop);
+        for (int i = 0; i < n; ++i) on_completion(loop, &cqes[i]);
+    } else {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(loop->epfd, events, MAX_EVENTS, timeout_ms);
+        loop->now_ms = clock_ms();
+        unpark_shm(loop);
+
+        for (int i = 0; i < n; ++i) {
+            conn_t *c = events[i].data.ptr;
+            if (c->fd < 0) continue;
+
+            if (c->kind == CONN_LISTENER) {
+                accept_conns(loop, c);
+                continue;
+            }
+            if (c->kind == CONN_NOTIFY) {
+                drain_notify(loop, c);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                read_conn(loop, c);
+            }
+            if (c->fd >= 0 && (events[i].events & EPOLLOUT)) {
+                flush_conn(loop, c);
+                check_drain(loop, c);
+            }
+        }
+    }
+
+    tw_advance(&loop->timers, loop->now_ms);
+
+    // everything queued during this iteration goes out together. with io_uring
+    // the sends are only posted here and submitted by the next uring_wait
+    while (loop->dirty) {
+        conn_t *c = loop->dirty;
+        loop->dirty = c->next_dirty;
+        c->next_dirty = NULL;
+        c->dirty = 0;
+        flush_conn(loop, c);
+        check_drain(loop, c);
+    }
+
+    while (loop->graveyard) {
+        conn_t *c = loop->graveyard;
+        loop->graveyard = c->next_closed;
+        if (c->inflight == 0) free_conn(loop, c);
+        else c->buried = 1;
+    }
+}
+
+void loop_timer(event_loop_t *loop, tw_timer_t *t, uint64_t ms, tw_callback_t fn, void *arg)
+{
+    tw_add(&loop->timers, t, loop->now_ms + ms, fn, arg);
+}
+
+void loop_cancel_timer(event_loop_t *loop, tw_timer_t *t)
+{
+    tw_cancel(&loop->timers, t);
+}
+
+void loop_fini(event_loop_t *loop)
+{
+    if (loop->uring) {
+        uring_close(loop->uring);
+        loop->uring = NULL;
+        free(loop->pool);
+        loop->pool = NULL;
+    }
+    if (loop->epfd >= 0) close(loop->epfd);
+    loop->epfd = -1;
+}
+
+static void mark_dirty(event_loop_t *loop, conn_t *c)
+{
+    if (!c->dirty) {
+        c->dirty = 1;
+        c->next_dirty = loop->dirty;
+        loop->dirty = c;
+    }
+}
+
+int conn_write(event_loop_t *loop, conn_t *c, const void *buf, size_t len)
+{
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = len };
+    return conn_writev(loop, c, &iov, 1);
+}
+
+int conn_writev(event_loop_t *loop, conn_t *c, const struct iovec *iov, int iovcnt)
+{
+    if (c->fd < 0 || c->closing) return -1;
+
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) len += iov[i].iov_len;
+
+    if (c->wlen + len > CONN_BUFFER_SIZE && (!loop->uring || c->shm)) {
+        // try to make room before giving up on the client
+        flush_conn(loop, c);
+    }
+    if (c->fd < 0) return -1;
+    if (c->wlen + len > CONN_BUFFER_SIZE) {
+        // dropping the message would leave a hole in the stream, the client cannot catch up
+        close_now(loop, c);
+        return -1;
+    }
+
+    for (int i = 0; i < iovcnt; ++i) {
+        const unsigned char *src = iov[i].iov_base;
+        size_t n = iov[i].iov_len;
+        while (n > 0) {
+            size_t tail = (c->woff + c->wlen) % CONN_BUFFER_SIZE;
+            size_t room = CONN_BUFFER_SIZE - tail;
+            size_t k = n < room ? n : room;
+            memcpy(c->wbuf + tail, src, k);
+            c->wlen += k;
+            src += k;
+            n -= k;
+        }
+    }
+    if (c->wlen > CONN_WBUF_HIGH) c->congested = 1;
+    mark_dirty(loop, c);
+    return 0;
+}
+
+shared_frame_t *frame_new(const void *buf, size_t len)
+{
+    shared_frame_t *f = malloc(sizeof *f + len);
+    if (!f) return NULL;
+    f->refs = 1;
+    f->len = len;
+    memcpy(f->data, buf, len);
+    return f;
+}
+
+void frame_put(shared_frame_t *f)
+{
+    if (--f->refs == 0) free(f);
+}
+
+int conn_write_shared(event_loop_t *loop, conn_t *c, shared_frame_t *f)
+{
+    if (c->fd < 0 || c->closing) return -1;
+
+    if (c->frame_cnt == CONN_FRAMES && (!loop->uring || c->shm)) flush_conn(loop, c);
+    if (c->fd < 0) return -1;
+    if (c->frame_cnt == CONN_FRAMES) {
+        close_now(loop, c);
+        return -1;
+    }
+
+    ++f->refs;
+    c->frames[(c->frame_head + c->frame_cnt) % CONN_FRAMES] = f;
+    ++c->frame_cnt;
+    mark_dirty(loop, c);
+    return 0;
+}
+
+void conn_consume(event_loop_t *loop, conn_t *c, size_t n)
+{
+    if (n > c->rlen) n = c->rlen;
+    memmove(c->rbuf, c->rbuf + n, c->rlen - n);
+    c->rlen -= n;
+    if (c->fd >= 0) update_events(loop, c);
+}
+
+void conn_close(event_loop_t *loop, conn_t *c)
+{
+    if (c->fd < 0 || c->closing) return;
+    c->closing = 1;
+    ++loop->num_closing;
+    if (!unsent(c) && !c->dirty && !c->sending) close_now(loop, c);
+}
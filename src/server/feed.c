@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "feed.h"
+#include "protocol.h"
+
+typedef enum {
+    ITEM_INFO,
+    ITEM_END,
+    ITEM_HALT
+} item_kind_t;
+
+struct feed_item {
+    feed_item_t *next;
+    uint64_t due;                       // when it is let out
+    item_kind_t kind;
+    info_packet_t info;                 // for an INFO, the state the spectators are in once it is out
+    shared_frame_t *frame;              // NULL if nobody was there to encode it for
+};
+
+static const card_t no_hole[2] = { NOCARD, NOCARD };
+
+// a spectator's INFO, as one flat frame
+static size_t encode_info(const info_packet_t *base, const info_packet_t *info, uint8_t *out)
+{
+    proto_public_t pub;
+    uint8_t scratch[PROTO_SEAT_SCRATCH];
+    struct iovec iov[3];
+    proto_encode_info_public(base, info, &pub);
+    int n = proto_info_frame(&pub, base ? NULL : no_hole, scratch, iov);
+
+    size_t len = 0;
+    for (int i = 0; i < n; ++i) {
+        memcpy(out + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+static void drop_watchers(feed_t *f)
+{
+    conn_t *next;
+    for (conn_t *c = f->watchers; c; c = next) {
+        next = c->next_peer;
+        conn_close(f->loop, c);
+    }
+}
+
+static void let_out(feed_t *f, feed_item_t *item)
+{
+    if (item->kind == ITEM_INFO) {
+        f->shown = item->info;
+        f->in_hand = 1;
+    }
+    if (item->kind == ITEM_END) f->in_hand = 0;
+
+    if (item->frame) {
+        // a spectator who stopped reading is closed here, and unlinks itself
+        conn_t *next;
+        for (conn_t *c = f->watchers; c; c = next) {
+            next = c->next_peer;
+            conn_write_shared(f->loop, c, item->frame);
+        }
+        frame_put(item->frame);
+    }
+
+    if (item->kind == ITEM_HALT) {
+        drop_watchers(f);
+        if (f->on_closed) f->on_closed(f->closed_arg);
+    }
+}
+
+static void on_due(tw_timer_t *timer, void *arg)
+{
+    feed_t *f = arg;
+    uint64_t now = loop_now(f->loop);
+    while (f->head && f->head->due <= now) {
+        feed_item_t *item = f->head;
+        f->head = item->next;
+        if (!f->head) f->tail = NULL;
+        let_out(f, item);
+        free(item);
+    }
+    if (f->head) loop_timer(f->loop, &f->timer, f->head->due - now, on_due, f);
+}
+
+// nothing needs encoding while there is nobody to send it to, now or after the delay
+static int idle(feed_t *f)
+{
+    return !f->watchers && f->delay_ms <= 0;
+}
+
+// lets a frame out at once, or queues it behind the others to wait out the delay
+static void push(feed_t *f, item_kind_t kind, const info_packet_t *info, const uint8_t *buf, size_t len)
+{
+    feed_item_t now = { .kind = kind };
+    if (info) now.info = *info;
+    if (!idle(f)) {
+        now.frame = frame_new(buf, len);
+        // a spectator who misses a frame cannot make sense of the deltas after it
+        if (!now.frame) drop_watchers(f);
+    }
+    if (f->delay_ms <= 0) {
+        let_out(f, &now);
+        return;
+    }
+
+    feed_item_t *item = malloc(sizeof *item);
+    if (!item) {
+        if (now.frame) frame_put(now.frame);
+        drop_watchers(f);
+        if (kind == ITEM_HALT && f->on_closed) f->on_closed(f->closed_arg);
+        return;
+    }
+    *item = now;
+    item->due = loop_now(f->loop) + f->delay_ms;
+    if (f->tail) f->tail->next = item;
+    else f->head = item;
+    f->tail = item;
+    if (!tw_armed(&f->timer)) loop_timer(f->loop, &f->timer, f->delay_ms, on_due, f);
+}
+
+void feed_init(feed_t *f, event_loop_t *loop, int max_watchers, int delay_ms)
+{
+    memset(f, 0, sizeof *f);
+    f->loop = loop;
+    f->max_watchers = max_watchers;
+    f->delay_ms = delay_ms;
+    f->hand_start = 1;
+}
+
+int feed_add(feed_t *f, conn_t *c)
+{
+    if (f->num_watchers >= f->max_watchers) return -1;
+
+    // deltas still held back apply to what was let out last
+    shared_frame_t *snapshot = NULL;
+    if (f->in_hand) {
+        uint8_t frame[PROTO_MAX_FRAME];
+        snapshot = frame_new(frame, encode_info(NULL, &f->shown, frame));
+        if (!snapshot) return -1;
+    }
+
+    c->prev_peer = NULL;
+    c->next_peer = f->watchers;
+    if (f->watchers) f->watchers->prev_peer = c;
+    f->watchers = c;
+    ++f->num_watchers;
+    if (snapshot) {
+        conn_write_shared(f->loop, c, snapshot);
+        frame_put(snapshot);
+    }
+    return 0;
+}
+
+void feed_remove(feed_t *f, conn_t *c)
+{
+    if (c->prev_peer) c->prev_peer->next_peer = c->next_peer;
+    else f->watchers = c->next_peer;
+    if (c->next_peer) c->next_peer->prev_peer = c->prev_peer;
+    c->next_peer = c->prev_peer = NULL;
+    --f->num_watchers;
+}
+
+void feed_heard(feed_t *f, conn_t *c)
+{
+    conn_consume(f->loop, c, c->rlen);
+    if (c->eof) conn_close(f->loop, c);
+}
+
+void feed_info(feed_t *f, const info_packet_t *info)
+{
+    uint8_t frame[PROTO_MAX_FRAME];
+    size_t len = idle(f) ? 0 : encode_info(f->hand_start ? NULL : &f->encoded, info, frame);
+    f->encoded = *info;
+    f->hand_start = 0;
+    push(f, ITEM_INFO, info, frame, len);
+}
+
+void feed_end(feed_t *f, const uint8_t *frame, size_t len)
+{
+    f->hand_start = 1;
+    push(f, ITEM_END, NULL, frame, len);
+}
+
+void feed_halt(feed_t *f, const uint8_t *frame, size_t len, void (*on_closed)(void *arg), void *arg)
+{
+    f->on_closed = on_closed;
+    f->closed_arg = arg;
+    push(f, ITEM_HALT, NULL, frame, len);
+}
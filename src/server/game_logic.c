@@ -8,25 +8,13 @@
 #include "poker_client.h"
 #include "client_action_handler.h"
 #include "game_logic.h"
+#include "hand_eval.h"
 #include "logs.h"
 
 
-static int descending(const void *lhs, const void *rhs) {
-    return (*(const int *)rhs) - (*(const int *)lhs);
-}
-
-static int pack_detail(const int *vals, int n) {
-    int out = 0;
-    for (int i = 0; i < n; ++i) {
-        out = (out << 4) | vals[i];
-    }
-    return out;
-}
-
 void print_game_state(game_state_t *game) { (void)game; }
 
-void init_deck(card_t deck[DECK_SIZE], int seed) {
-    srand(seed);
+void init_deck(card_t deck[DECK_SIZE]) {
     int idx = 0;
     for (int r = 0; r < 13; ++r) {
         for (int s = 0; s < 4; ++s) {
@@ -35,18 +23,48 @@ void init_deck(card_t deck[DECK_SIZE], int seed) {
     }
 }
 
-void shuffle_deck(card_t deck[DECK_SIZE]) {
-    for (int i = 0; i < DECK_SIZE; ++i) {
-        int j = rand() % DECK_SIZE;
+// fisher-yates: every card is swapped with one drawn uniformly from those not yet placed.
+// dealing with draw_card gives the same cards without shuffling the whole deck
+void shuffle_deck(card_t deck[DECK_SIZE], rng_t *rng) {
+    for (int i = 0; i < DECK_SIZE - 1; ++i) {
+        int j = i + rng_below(rng, DECK_SIZE - i);
         card_t tmp = deck[i];
         deck[i] = deck[j];
         deck[j] = tmp;
     }
 }
 
+/**
+ * starts the random stream of the next hand. each (table, hand) pair gets its
+ * own stream of the server seed, so tables never share generator state and any
+ * hand can be replayed from the seed, table id and hand number alone.
+ */
+void seed_hand(game_state_t *g) {
+    uint64_t stream = ((uint64_t)g->table_id << 32) | (uint32_t)g->hand_number;
+    rng_init(&g->rng, g->seed, stream);
+    ++g->hand_number;
+}
+
+/**
+ * deals the next card with a single fisher-yates step: the card is drawn
+ * uniformly from those not dealt yet and swapped into place. the hand's stream
+ * makes the same draws a full shuffle_deck would, so a hand deals the same
+ * cards either way but only pays for the cards it uses.
+ */
+card_t draw_card(game_state_t *g) {
+    int i = g->next_card++;
+    int j = i + rng_below(&g->rng, DECK_SIZE - i);
+    card_t card = g->deck[j];
+    g->deck[j] = g->deck[i];
+    g->deck[i] = card;
+    return card;
+}
+
 void init_game_state(game_state_t *st, int initial_stack, int seed) {
     memset(st, 0, sizeof *st);
-    init_deck(st->deck, seed);
+    hand_eval_init();
+    init_deck(st->deck);
+    st->seed = (uint64_t)seed;
     st->round_stage = ROUND_INIT;
     st->dealer_player = -1;
     st->current_player = -1;
@@ -66,56 +84,77 @@ void init_game_state(game_state_t *st, int initial_stack, int seed) {
     st->next_card = 0;
     st->highest_bet = 0;
     st->pot_size = 0;
+    reset_hand_states(st);
 }
 
-void server_join(game_state_t *g) {
-    player_id_t id = g->current_player;
-
-    if (g->player_status[id] != PLAYER_LEFT) {
-        return;
-    }
+void reset_game_state(game_state_t *gs) {
+    // cards are shuffled in as they are dealt (see draw_card)
+    seed_hand(gs);
+    init_deck(gs->deck);
 
-    g->player_status[id] = PLAYER_ACTIVE;
-    ++g->num_players;
+    gs->round_stage = ROUND_INIT;
+    gs->next_card = 0;
+    gs->highest_bet = 0;
+    gs->pot_size = 0;
 
-    log_info("Player %d joined (total=%d)", id, g->num_players);
-}
+    memset(gs->current_bets, 0, sizeof gs->current_bets);
+    memset(gs->contributions, 0, sizeof gs->contributions);
+    gs->num_pots = 0;
 
-int server_ready(game_state_t *g) {
-    player_id_t seat = g->current_player;
-    static int ready_total = 0;
-    static int ready_seen[MAX_PLAYERS] = {0};
+    for (player_id_t p = 0; p < MAX_PLAYERS; ++p) {
+        if (gs->player_status[p] != PLAYER_LEFT) {
+            gs->player_status[p] = PLAYER_ACTIVE;
+        }
 
-    if (!ready_seen[seat]) {
-        ready_seen[seat] = 1;
-        ++ready_total;
-        log_info("Player %d is ready (%d/%d)", seat, ready_total, MAX_PLAYERS);
+        gs->player_hands[p][0] = NOCARD;
+        gs->player_hands[p][1] = NOCARD;
     }
 
-    if (ready_total < MAX_PLAYERS) {
-        return 0;
-    }
+    memset(gs->community_cards, NOCARD, sizeof gs->community_cards);
+    reset_hand_states(gs);
+}
 
-    memset(ready_seen, 0, sizeof ready_seen);
-    ready_total = 0;
+void reset_hand_states(game_state_t *g) {
+    hand_state_clear(&g->board_state);
+    for (int seat = 0; seat < MAX_PLAYERS; ++seat) {
+        hand_state_clear(&g->hand_states[seat]);
+        g->hand_scores[seat] = 0;
+    }
+}
 
-    g->round_stage = ROUND_PREFLOP;
-    g->next_card = 0;
-    g->highest_bet = 0;
-    g->pot_size = 0;
+// adds a community card to the board and to every hand that has been dealt
+static void deal_community_card(game_state_t *g, int idx) {
+    card_t card = draw_card(g);
+    g->community_cards[idx] = card;
+    hand_state_add(&g->board_state, card);
+    for (int seat = 0; seat < MAX_PLAYERS; ++seat) {
+        if (g->hand_states[seat].count) {
+            hand_state_add(&g->hand_states[seat], card);
+        }
+    }
+}
 
-    server_deal(g);
-    g->current_player = (g->dealer_player + 1) % MAX_PLAYERS;
-    return 1;
+// rescores every dealt hand from its state, which already holds the board dealt so far
+static void score_hands(game_state_t *g) {
+    for (int seat = 0; seat < MAX_PLAYERS; ++seat) {
+        if (g->hand_states[seat].count) {
+            g->hand_scores[seat] = hand_eval_state(&g->hand_states[seat]);
+        }
+    }
 }
 
 void server_deal(game_state_t *g) {
     for (int seat = 0; seat < MAX_PLAYERS; ++seat) {
         if (g->player_status[seat] == PLAYER_ACTIVE) {
-            g->player_hands[seat][0] = g->deck[g->next_card++];
-            g->player_hands[seat][1] = g->deck[g->next_card++];
+            g->player_hands[seat][0] = draw_card(g);
+            g->player_hands[seat][1] = draw_card(g);
+
+            g->hand_states[seat] = g->board_state;
+            hand_state_add(&g->hand_states[seat], g->player_hands[seat][0]);
+            hand_state_add(&g->hand_states[seat], g->player_hands[seat][1]);
         }
     }
+    score_hands(g);
 }
 
 int check_betting_end(game_state_t *g) {
@@ -130,37 +169,22 @@ int check_betting_end(game_state_t *g) {
     return 1;
 }
 
-int server_bet(game_state_t *state) {
-    if (check_betting_end(state)) {
-        return 1;
-    }
-
-    while (1) {
-        state->current_player = (state->current_player + 1) % MAX_PLAYERS;
-
-        if (state->player_status[state->current_player] == PLAYER_ACTIVE) {
-            break;
-        }
-    }
-    return 0;
-}
-
 void server_community(game_state_t *g) {
     switch (g->round_stage) {
         case ROUND_PREFLOP: {
             for (int c = 0; c < 3; ++c) {
-                g->community_cards[c] = g->deck[g->next_card++];
+                deal_community_card(g, c);
             }
             g->round_stage = ROUND_FLOP;
             break;
         }
         case ROUND_FLOP: {
-            g->community_cards[3] = g->deck[g->next_card++];
+            deal_community_card(g, 3);
             g->round_stage = ROUND_TURN;
             break;
         }
         case ROUND_TURN: {
-            g->community_cards[4] = g->deck[g->next_card++];
+            deal_community_card(g, 4);
             g->round_stage = ROUND_RIVER;
             break;
         }
@@ -168,233 +192,90 @@ void server_community(game_state_t *g) {
             break;
         }
     }
+    score_hands(g);
     g->current_player = (g->dealer_player + 1) % MAX_PLAYERS;
 }
 
-void server_end(game_state_t *g) {
-    player_id_t champ = find_winner(g);
-    log_info("Hand ended, winner = %d", champ);
-    g->player_stacks[champ] += g->pot_size;
-    g->round_stage = ROUND_SHOWDOWN;
-}
-
-static int hand_value(const card_t *cards, int count) {
-    int rank_cnt[13] = {0};
-    int suit_cnt[4] = {0};
-
-    for (int i = 0; i < count; ++i) {
-        int rank = cards[i] >> SUITE_BITS;
-        int suit = cards[i] & ((1 << SUITE_BITS) - 1);
-        rank_cnt[rank]++;
-        suit_cnt[suit]++;
-    }
-
-    int uniq[14];
-    int uniq_cnt = 0;
-    for (int r = 12; r >= 0; --r) {
-        if (rank_cnt[r]) {
-            uniq[uniq_cnt++] = r;
-        }
-    }
-    if (rank_cnt[12]) {
-        uniq[uniq_cnt++] = -1;
-    }
-
-    int best_sf = -1;
-    for (int s = 0; s < 4; ++s) {
-        if (suit_cnt[s] < 5) {
-            continue;
-        }
-        int sr[7];
-        int m = 0;
-        for (int i = 0; i < count; ++i) {
-            if ((cards[i] & ((1 << SUITE_BITS) - 1)) == s) {
-                sr[m++] = cards[i] >> SUITE_BITS;
-            }
-        }
-        qsort(sr, m, sizeof *sr, descending);
-        int su[8];
-        int k = 0;
-        int last = -2;
-        for (int i = 0; i < m; ++i) {
-            if (sr[i] != last) {
-                su[k++] = sr[i];
-                last = sr[i];
-            }
-        }
-        if (last == 12) {
-            su[k++] = -1;
-        }
-        for (int i = 0; i + 4 < k; ++i) {
-            if (su[i] - su[i + 4] == 4) {
-                best_sf = su[i];
-                break;
-            }
-        }
-        if (best_sf >= 0) {
-            break;
-        }
-    }
-    if (best_sf >= 0) {
-        return (8 << 20) | (best_sf << 16);
-    }
-
-    for (int r = 12; r >= 0; --r) {
-        if (rank_cnt[r] == 4) {
-            int kicker = -1;
-            for (int t = 12; t >= 0; --t) {
-                if (t != r && rank_cnt[t]) {
-                    kicker = t;
-                    break;
-                }
-            }
-            return (7 << 20) | (r << 16) | (kicker << 12);
-        }
-    }
 
-    int three = -1;
-    int pair = -1;
-    for (int r = 12; r >= 0; --r) {
-        if (rank_cnt[r] >= 3) {
-            three = r;
-            break;
-        }
-    }
-    if (three >= 0) {
-        for (int r = 12; r >= 0; --r) {
-            if (r != three && rank_cnt[r] >= 2) {
-                pair = r;
-                break;
-            }
-        }
-    }
-    if (three >= 0 && pair >= 0) {
-        return (6 << 20) | (three << 16) | (pair << 12);
-    }
+static int still_in_hand(const game_state_t *g, int seat) {
+    return g->player_status[seat] == PLAYER_ACTIVE || g->player_status[seat] == PLAYER_ALLIN;
+}
 
-    for (int s = 0; s < 4; ++s) {
-        if (suit_cnt[s] >= 5) {
-            int vals[5];
-            int k = 0;
-            for (int r = 12; r >= 0 && k < 5; --r) {
-                for (int i = 0; i < count && k < 5; ++i) {
-                    if ((cards[i] & ((1 << SUITE_BITS) - 1)) == s &&
-                        (cards[i] >> SUITE_BITS) == r) {
-                        vals[k++] = r;
-                    }
-                }
-            }
-            return (5 << 20) | pack_detail(vals, 5);
-        }
-    }
+// splits a pot between its winners, odd chips going one each to the first winners left of the dealer
+static void pay_pot(game_state_t *g, const pot_result_t *pot) {
+    int winners = __builtin_popcount(pot->winners);
+    int share = pot->amount / winners;
+    int odd = pot->amount % winners;
 
-    int top_st = -1;
-    for (int i = 0; i + 4 < uniq_cnt; ++i) {
-        int hi = uniq[i] < 0 ? 3 : uniq[i];
-        int lo = uniq[i + 4] < 0 ? 0 : uniq[i + 4];
-        if (hi - lo == 4) {
-            top_st = hi;
-            break;
+    for (int i = 1; i <= MAX_PLAYERS; ++i) {
+        int seat = (g->dealer_player + i + MAX_PLAYERS) % MAX_PLAYERS;
+        if (pot->winners & (1 << seat)) {
+            g->player_stacks[seat] += share + (odd-- > 0);
         }
     }
-    if (top_st >= 0) {
-        return (4 << 20) | (top_st << 16);
-    }
+}
 
-    if (three >= 0) {
-        int kick[2];
-        int k = 0;
-        for (int r = 12; r >= 0 && k < 2; --r) {
-            if (r != three && rank_cnt[r]) {
-                kick[k++] = r;
-            }
+/**
+ * pays out the pot. the main pot and each side pot are the layers between the
+ * totals that players still in the hand have put in; folded chips are dead
+ * money in whichever layers they reach. seats are sorted once by contribution
+ * and then swept from the largest down: every seat still in the hand joins
+ * the running best, which closes off the layers above it as a pot for the
+ * players who could win them. layers nobody put chips into are not pots.
+ * returns the first winner of the main pot.
+ */
+int settle_pots(game_state_t *g) {
+    int order[MAX_PLAYERS];
+    int n = 0;
+    for (int seat = 0; seat < MAX_PLAYERS; ++seat) {
+        if (still_in_hand(g, seat) || g->contributions[seat] > 0) {
+            order[n++] = seat;
         }
-        return (3 << 20) | (three << 16) | pack_detail(kick, 2);
     }
 
-    int p1 = -1;
-    int p2 = -1;
-    for (int r = 12; r >= 0; --r) {
-        if (rank_cnt[r] >= 2) {
-            if (p1 < 0) {
-                p1 = r;
-            } else if (p2 < 0) {
-                p2 = r;
-                break;
-            }
+    // insertion sort by contribution, there are at most MAX_PLAYERS seats
+    for (int i = 1; i < n; ++i) {
+        int seat = order[i];
+        int j = i;
+        for (; j > 0 && g->contributions[order[j - 1]] > g->contributions[seat]; --j) {
+            order[j] = order[j - 1];
         }
-    }
-    if (p1 >= 0 && p2 >= 0) {
-        int kicker = -1;
-        for (int r = 12; r >= 0; --r) {
-            if (r != p1 && r != p2 && rank_cnt[r]) {
-                kicker = r;
-                break;
+        order[j] = seat;
+    }
+
+    pot_result_t side[MAX_POTS];
+    int num_side = 0;
+    int amount = 0;     // chips above the level being swept that no pot holds yet
+    int best = -1;
+    int winners = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        int seat = order[i];
+        if (still_in_hand(g, seat)) {
+            if (amount > 0 && winners) {
+                side[num_side++] = (pot_result_t){ .amount = amount, .winners = winners };
+                amount = 0;
             }
-        }
-        int tmp[3] = {p1, p2, kicker};
-        return (2 << 20) | pack_detail(tmp, 3);
-    }
-
-    if (p1 >= 0) {
-        int kick[3];
-        int k = 0;
-        for (int r = 12; r >= 0 && k < 3; --r) {
-            if (r != p1 && rank_cnt[r]) {
-                kick[k++] = r;
+            if (g->hand_scores[seat] > best) {
+                best = g->hand_scores[seat];
+                winners = 1 << seat;
+            } else if (g->hand_scores[seat] == best) {
+                winners |= 1 << seat;
             }
         }
-        int tmp[4] = {p1, kick[0], kick[1], kick[2]};
-        return (1 << 20) | pack_detail(tmp, 4);
-    }
-
-    int hc[5];
-    int h = 0;
-    for (int r = 12; r >= 0 && h < 5; --r) {
-        if (rank_cnt[r]) {
-            hc[h++] = r;
-        }
+        int below = (i > 0) ? g->contributions[order[i - 1]] : 0;
+        amount += (g->contributions[seat] - below) * (n - i);
     }
-    while (h < 5) {
-        hc[h++] = 0;
+    if (amount > 0 && winners) {
+        side[num_side++] = (pot_result_t){ .amount = amount, .winners = winners };
     }
-    return (0 << 20) | pack_detail(hc, 5);
-}
 
-int evaluate_hand(game_state_t *g, player_id_t p) {
-    card_t buf[7];
-    int n = 0;
-
-    if (g->player_hands[p][0] != NOCARD) {
-        buf[n++] = g->player_hands[p][0];
-    }
-    if (g->player_hands[p][1] != NOCARD) {
-        buf[n++] = g->player_hands[p][1];
-    }
-    for (int i = 0; i < MAX_COMMUNITY_CARDS; ++i) {
-        if (g->community_cards[i] != NOCARD) {
-            buf[n++] = g->community_cards[i];
-        }
+    // the sweep found the pots from the top down, the main pot comes first
+    g->num_pots = num_side;
+    for (int p = 0; p < num_side; ++p) {
+        g->pots[p] = side[num_side - 1 - p];
+        pay_pot(g, &g->pots[p]);
     }
-    return hand_value(buf, n);
+    // a hand checked down to the end has no pot, it is still won by the best hand
+    if (g->num_pots) return __builtin_ctz(g->pots[0].winners);
+    return winners ? __builtin_ctz(winners) : -1;
 }
-
-int find_winner(game_state_t *g) {
-    int best_id   = -1;
-    int best_rank = -1;
-
-    for (int seat = 0; seat < MAX_PLAYERS; ++seat) {
-        if (g->player_status[seat] != PLAYER_ACTIVE &&
-            g->player_status[seat] != PLAYER_ALLIN) {
-            continue;
-        }
-
-        int score = evaluate_hand(g, seat);
-
-        if (score > best_rank) {
-            best_rank = score;
-            best_id   = seat;
-        }
-    }
-    return best_id;
-}
\ No newline at end of file
@@ -0,0 +1,374 @@
+// SO_REUSEPORT is not part of POSIX
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "shard.h"
+#include "protocol.h"
+
+// the tag of connections from the unix socket, only they can attach shared memory
+#define LOCAL_TAG 1
+
+struct handoff {
+    int fd;
+    shm_channel_t *shm;                 // the connection's channel, if it has one
+    size_t len;                         // bytes the client sent before the move
+    unsigned char buf[CONN_BUFFER_SIZE];
+    handoff_t *next;
+};
+
+static table_t *tables;
+static int num_tables;
+static shard_t *shards;
+static int num_shards;
+static const char *unix_path;
+
+// tables that have not halted yet, across every shard
+static atomic_int tables_running;
+
+int shard_of(int table_id)
+{
+    // table ids are dense, so a plain modulo spreads them evenly
+    return table_id % num_shards;
+}
+
+static table_t *find_table(int id)
+{
+    if (id < 0 || id >= num_tables) return NULL;
+    return &tables[id];
+}
+
+static int open_listener(int port)
+{
+    struct sockaddr_in addr = {0};
+    int opt = 1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int open_unix_listener(const char *path)
+{
+    struct sockaddr_un addr = {0};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    // a socket file left behind by an earlier run would make bind fail
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void drop_handoff(handoff_t *h)
+{
+    close(h->fd);
+    if (h->shm) shm_channel_close(h->shm);
+    free(h);
+}
+
+// moves a connection that has not joined yet, and everything it sent, to another shard
+static void hand_off(event_loop_t *loop, conn_t *c, shard_t *to)
+{
+    handoff_t *h = malloc(sizeof *h);
+    if (!h) {
+        conn_close(loop, c);
+        return;
+    }
+    h->len = c->rlen;
+    memcpy(h->buf, c->rbuf, c->rlen);
+    h->shm = c->shm;
+    h->fd = loop_release(loop, c);
+
+    pthread_mutex_lock(&to->inbox_lock);
+    bool open = !to->exited;
+    if (open) {
+        h->next = to->inbox;
+        to->inbox = h;
+    }
+    pthread_mutex_unlock(&to->inbox_lock);
+
+    if (open) {
+        loop_notify(to->notify);
+    } else {
+        drop_handoff(h);
+    }
+}
+
+// a local client may first ask to carry the connection over shared memory
+static int attach(event_loop_t *loop, conn_t *c)
+{
+    char name[SHM_NAME_MAX];
+    int size = proto_decode_attach(c->rbuf, c->rlen, name, sizeof name);
+    if (size == 0) {
+        if (c->eof) conn_close(loop, c);
+        return -1;
+    }
+
+    shm_channel_t *shm = size > 0 && c->tag == LOCAL_TAG ? shm_channel_open(name) : NULL;
+    if (!shm) {
+        conn_close(loop, c);
+        return -1;
+    }
+    // anything after ATTACH on the socket is a doorbell, JOIN comes through the channel
+    conn_consume(loop, c, c->rlen);
+    conn_attach_shm(loop, c, shm);
+    return 0;
+}
+
+// a player who lost their connection takes their seat back with its session token
+static int resume(event_loop_t *loop, conn_t *c)
+{
+    int table_id;
+    player_id_t seat;
+    uint64_t token;
+    int size = proto_decode_resume(c->rbuf, c->rlen, &table_id, &seat, &token);
+    if (size == 0) {
+        if (c->eof) conn_close(loop, c);
+        return -1;
+    }
+
+    table_t *t = size > 0 ? find_table(table_id) : NULL;
+    if (!t) {
+        conn_close(loop, c);
+        return -1;
+    }
+    if (t->loop != loop) {
+        hand_off(loop, c, &shards[shard_of(t->id)]);
+        return -1;
+    }
+
+    conn_consume(loop, c, size);
+    if (table_resume(t, seat, token, c) < 0) {
+        conn_close(loop, c);
+        return -1;
+    }
+    return 0;
+}
+
+// a spectator follows a table without a seat
+static int watch(event_loop_t *loop, conn_t *c)
+{
+    int table_id;
+    int size = proto_decode_watch(c->rbuf, c->rlen, &table_id);
+    if (size == 0) {
+        if (c->eof) conn_close(loop, c);
+        return -1;
+    }
+
+    table_t *t = size > 0 ? find_table(table_id) : NULL;
+    if (!t) {
+        conn_close(loop, c);
+        return -1;
+    }
+    if (t->loop != loop) {
+        hand_off(loop, c, &shards[shard_of(t->id)]);
+        return -1;
+    }
+
+    conn_consume(loop, c, size);
+    if (table_watch(t, c) < 0) {
+        conn_close(loop, c);
+        return -1;
+    }
+    return 0;
+}
+
+// the first packet of a connection must be JOIN, it names the table and seat to
+// take. RESUME takes back a seat instead, and WATCH only follows the table
+static int join(event_loop_t *loop, conn_t *c)
+{
+    if (!c->shm && proto_frame_type(c->rbuf, c->rlen) == PROTO_ATTACH && attach(loop, c) < 0) return -1;
+    if (proto_frame_type(c->rbuf, c->rlen) == PROTO_RESUME) return resume(loop, c);
+    if (proto_frame_type(c->rbuf, c->rlen) == PROTO_WATCH) return watch(loop, c);
+
+    client_packet_t first_msg;
+    int size = proto_decode_client(c->rbuf, c->rlen, &first_msg);
+    if (size == 0) {
+        if (c->eof) conn_close(loop, c);
+        return -1;
+    }
+
+    table_t *t = size > 0 ? find_table(first_msg.params[0]) : NULL;
+    if (!t || first_msg.packet_type != JOIN) {
+        conn_close(loop, c);
+        return -1;
+    }
+    if (t->loop != loop) {
+        hand_off(loop, c, &shards[shard_of(t->id)]);
+        return -1;
+    }
+
+    conn_consume(loop, c, size);
+    if (table_seat(t, first_msg.params[1], c) < 0) {
+        conn_close(loop, c);
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_all(void)
+{
+    for (int i = 0; i < num_shards; ++i) loop_notify(shards[i].notify);
+}
+
+static void on_data(event_loop_t *loop, conn_t *c)
+{
+    if (!c->owner && join(loop, c) < 0) return;
+    table_data(c->owner, c);
+}
+
+static void on_table_halt(table_t *t)
+{
+    if (atomic_fetch_sub(&tables_running, 1) == 1) stop_all();
+}
+
+static void on_close(event_loop_t *loop, conn_t *c)
+{
+    if (c->owner) table_detach(c->owner, c);
+}
+
+static void on_drain(event_loop_t *loop, conn_t *c)
+{
+    if (c->owner) table_drained(c->owner, c);
+}
+
+static void on_notify(event_loop_t *loop, conn_t *notify)
+{
+    shard_t *self = loop->ctx;
+
+    pthread_mutex_lock(&self->inbox_lock);
+    handoff_t *h = self->inbox;
+    self->inbox = NULL;
+    pthread_mutex_unlock(&self->inbox_lock);
+
+    while (h) {
+        handoff_t *next = h->next;
+        conn_t *c = loop_adopt(loop, h->fd, h->buf, h->len, h->shm);
+        if (c) on_data(loop, c);
+        free(h);
+        h = next;
+    }
+}
+
+static const loop_ops_t shard_ops = {
+    .on_data = on_data,
+    .on_close = on_close,
+    .on_notify = on_notify,
+    .on_drain = on_drain,
+};
+
+static void *shard_main(void *arg)
+{
+    shard_t *self = arg;
+
+    // keep going until every table halts and everything queued for them has been sent
+    while (atomic_load(&tables_running) > 0 || self->loop.num_closing > 0) {
+        loop_run_once(&self->loop, -1);
+    }
+
+    pthread_mutex_lock(&self->inbox_lock);
+    self->exited = 1;
+    handoff_t *h = self->inbox;
+    self->inbox = NULL;
+    pthread_mutex_unlock(&self->inbox_lock);
+    while (h) {
+        handoff_t *next = h->next;
+        drop_handoff(h);
+        h = next;
+    }
+
+    loop_unlisten(&self->loop, self->listener);
+    if (self->unix_listener) loop_unlisten(&self->loop, self->unix_listener);
+    return NULL;
+}
+
+int shards_init(int want_shards, int want_tables, int port, const char *path, const table_config_t *cfg,
+                loop_backend_t backend)
+{
+    num_tables = want_tables;
+    num_shards = want_shards;
+    if (num_shards <= 0) num_shards = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_shards <= 0) num_shards = 1;
+    if (num_shards > num_tables) num_shards = num_tables;
+
+    tables = calloc(num_tables, sizeof *tables);
+    shards = calloc(num_shards, sizeof *shards);
+    if (!tables || !shards) return -1;
+
+    for (int i = 0; i < num_shards; ++i) {
+        shard_t *s = &shards[i];
+        s->id = i;
+        pthread_mutex_init(&s->inbox_lock, NULL);
+        if (loop_init(&s->loop, &shard_ops, s, backend) < 0) return -1;
+        if (i == 0 && s->loop.backend != backend) fprintf(stderr, "[Server] io_uring is not available, using epoll.\n");
+
+        int fd = open_listener(port);
+        if (fd < 0) return -1;
+        s->listener = loop_listen(&s->loop, fd, 0);
+        s->notify = loop_notifier(&s->loop);
+        if (!s->listener || !s->notify) return -1;
+    }
+
+    if (path) {
+        // one listener is plenty for local clients, the JOIN handoff gets them to their table's shard
+        int fd = open_unix_listener(path);
+        if (fd < 0) return -1;
+        unix_path = path;
+        shards[0].unix_listener = loop_listen(&shards[0].loop, fd, LOCAL_TAG);
+        if (!shards[0].unix_listener) return -1;
+    }
+
+    for (int id = 0; id < num_tables; ++id) {
+        table_init(&tables[id], &shards[shard_of(id)].loop, id, cfg);
+        tables[id].on_halt = on_table_halt;
+    }
+    atomic_store(&tables_running, num_tables);
+    return 0;
+}
+
+void shards_run(void)
+{
+    for (int i = 1; i < num_shards; ++i) {
+        pthread_create(&shards[i].thread, NULL, shard_main, &shards[i]);
+    }
+    // the main thread runs the first shard itself
+    shard_main(&shards[0]);
+    for (int i = 1; i < num_shards; ++i) {
+        pthread_join(shards[i].thread, NULL);
+    }
+}
+
+void shards_fini(void)
+{
+    for (int i = 0; i < num_shards; ++i) {
+        loop_fini(&shards[i].loop);
+        pthread_mutex_destroy(&shards[i].inbox_lock);
+    }
+    free(shards);
+    free(tables);
+    if (unix_path) unlink(unix_path);
+}
@@ -0,0 +1,640 @@
+// getentropy is only POSIX as of 2024, older C libraries hide it
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "table.h"
+#include "client_action_handler.h"
+#include "protocol.h"
+
+#define EACH_PLAYER for (int pid = 0; pid < MAX_PLAYERS; ++pid)
+#define NEXT(i) ((i + 1) % MAX_PLAYERS)
+#define ALL_SEATS ((1 << MAX_PLAYERS) - 1)
+
+static void send_pkt(table_t *t, player_id_t pid, const server_packet_t *pkt)
+{
+    conn_t *c = t->conns[pid];
+    if (!c) return;
+    uint8_t frame[PROTO_MAX_FRAME];
+    size_t len = proto_encode_server(pkt, frame);
+    conn_write(t->loop, c, frame, len);
+}
+
+static int count_active_players(table_t *t)
+{
+    int n = 0;
+    EACH_PLAYER if (t->game.player_status[pid] == PLAYER_ACTIVE) ++n;
+    return n;
+}
+
+// players who can still win the pot, whether or not they can still bet
+static int count_in_hand(table_t *t)
+{
+    int n = 0;
+    EACH_PLAYER if (t->game.player_status[pid] == PLAYER_ACTIVE || t->game.player_status[pid] == PLAYER_ALLIN) ++n;
+    return n;
+}
+
+// the first active player after start, -1 if nobody is left to act
+static player_id_t next_active_player(table_t *t, player_id_t start)
+{
+    int cur = start;
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        cur = NEXT(cur);
+        if (t->game.player_status[cur] == PLAYER_ACTIVE) return cur;
+    }
+    return -1;
+}
+
+// queues one seat's INFO around an encoded public part, hole may be NULL for a delta
+static void send_info(table_t *t, player_id_t pid, const proto_public_t *pub, const card_t *hole)
+{
+    uint8_t scratch[PROTO_SEAT_SCRATCH];
+    struct iovec iov[3];
+    int n = proto_info_frame(pub, hole, scratch, iov);
+    memcpy(t->sent_hole[pid], t->game.player_hands[pid], sizeof t->sent_hole[pid]);
+    conn_writev(t->loop, t->conns[pid], iov, n);
+}
+
+// the public part is encoded once per update (twice if some seats need a full
+// snapshot), each seat only adds its own header and hole cards around it
+static void broadcast_info(table_t *t)
+{
+    info_packet_t info;
+    build_public_info(&t->game, &info);
+
+    proto_public_t delta, full;
+    int have_delta = 0, have_full = 0;
+    EACH_PLAYER {
+        conn_t *c = t->conns[pid];
+        if (!c) continue;
+
+        // a seat that is not reading sits out the updates, it gets a snapshot once it catches up
+        if (c->congested) {
+            t->info_synced &= ~(1 << pid);
+            continue;
+        }
+
+        const card_t *hole = t->game.player_hands[pid];
+        if (t->info_synced & (1 << pid)) {
+            if (!have_delta) proto_encode_info_public(&t->sent_public, &info, &delta);
+            have_delta = 1;
+            if (!memcmp(t->sent_hole[pid], hole, sizeof t->sent_hole[pid])) hole = NULL;
+            send_info(t, pid, &delta, hole);
+        } else {
+            if (!have_full) proto_encode_info_public(NULL, &info, &full);
+            have_full = 1;
+            t->info_synced |= 1 << pid;
+            send_info(t, pid, &full, hole);
+        }
+    }
+    t->sent_public = info;
+    feed_info(&t->feed, &info);
+}
+
+// a packet that is the same for every seat, and the spectators, is encoded once
+static size_t broadcast(table_t *t, const server_packet_t *pkt, uint8_t *frame)
+{
+    size_t len = proto_encode_server(pkt, frame);
+    EACH_PLAYER if (t->conns[pid]) conn_write(t->loop, t->conns[pid], frame, len);
+    return len;
+}
+
+static void broadcast_end(table_t *t, int winner)
+{
+    server_packet_t pkt;
+    uint8_t frame[PROTO_MAX_FRAME];
+    build_end_packet(&t->game, winner, &pkt);
+    feed_end(&t->feed, frame, broadcast(t, &pkt, frame));
+}
+
+// links a connection to a seat
+static void attach(table_t *t, player_id_t pid, conn_t *c)
+{
+    t->conns[pid] = c;
+    t->info_synced &= ~(1 << pid);
+    t->game.sockets[pid] = c->fd;
+    c->owner = t;
+    c->seat = pid;
+}
+
+// unlinks a seat's connection, if it has one, and returns it
+static conn_t *detach(table_t *t, player_id_t pid)
+{
+    conn_t *c = t->conns[pid];
+    t->conns[pid] = NULL;
+    t->info_synced &= ~(1 << pid);
+    t->game.sockets[pid] = -1;
+    if (c) c->owner = NULL;
+    return c;
+}
+
+// closes a seat's connection once everything queued for it has been sent
+static void unseat(table_t *t, player_id_t pid)
+{
+    conn_t *c = detach(t, pid);
+    t->held &= ~(1 << pid);
+    // a player who said READY and then gave the seat up will not be dealt in
+    t->ready &= ~(1 << pid);
+    loop_cancel_timer(t->loop, &t->resume_timer[pid]);
+    if (t->game.player_status[pid] != PLAYER_LEFT) --t->game.num_players;
+    t->game.player_status[pid] = PLAYER_LEFT;
+    if (c) conn_close(t->loop, c);
+}
+
+static void on_resume_timeout(tw_timer_t *timer, void *arg);
+
+// keeps a dropped player's seat for resume_ms, whatever state the hand is in
+static void hold_seat(table_t *t, player_id_t pid)
+{
+    t->held |= 1 << pid;
+    loop_timer(t->loop, &t->resume_timer[pid], t->resume_ms, on_resume_timeout, t);
+}
+
+// a player who hung up with nothing left to read keeps the seat if there is a
+// resume window, the table then waits on them as if they were thinking
+static int hold_if_dropped(table_t *t, player_id_t pid)
+{
+    conn_t *c = t->conns[pid];
+    client_packet_t pkt;
+    if (t->resume_ms <= 0 || !c->eof || proto_decode_client(c->rbuf, c->rlen, &pkt) != 0) return 0;
+    conn_close(t->loop, detach(t, pid));
+    hold_seat(t, pid);
+    return 1;
+}
+
+// a seat that lost its player for good, who is only waited on until the hand lets them go
+static int abandoned(table_t *t, player_id_t pid)
+{
+    return !t->conns[pid] && !(t->held & (1 << pid)) && t->game.player_status[pid] != PLAYER_LEFT;
+}
+
+/**
+ * takes the next packet a seat has sent
+ *
+ * @return 1 if pkt was filled, 0 if no whole packet has arrived yet, -1 if the
+ *         player hung up (or was never there, or sent garbage) and nothing
+ *         more will arrive
+ */
+static int take_packet(table_t *t, player_id_t pid, client_packet_t *pkt)
+{
+    conn_t *c = t->conns[pid];
+    // a held seat is like a player who is thinking, the turn timer deals with it
+    if (!c) return t->held & (1 << pid) ? 0 : -1;
+    int size = proto_decode_client(c->rbuf, c->rlen, pkt);
+    if (size > 0) {
+        conn_consume(t->loop, c, size);
+        return 1;
+    }
+    if (size == 0 && hold_if_dropped(t, pid)) return 0;
+    // a malformed frame leaves the stream out of step, the player is as good as gone
+    return size < 0 || c->eof ? -1 : 0;
+}
+
+/**
+ * answers an action the table is not waiting for with a NACK, rather than
+ * keeping it for the seat's next turn. it is most likely one the player sent
+ * after the turn timer had already acted for them.
+ *
+ * @return 1 if a packet was refused, 0 if the seat has none to refuse
+ */
+static int refuse_out_of_turn(table_t *t, player_id_t pid)
+{
+    conn_t *c = t->conns[pid];
+    client_packet_t pkt;
+    if (!c || (t->phase == TABLE_BETTING && pid == t->game.current_player)) return 0;
+    // JOIN, LEAVE and READY wait for the table to get to them
+    int size = proto_decode_client(c->rbuf, c->rlen, &pkt);
+    if (size <= 0 || pkt.packet_type < RAISE) return 0;
+
+    conn_consume(t->loop, c, size);
+    server_packet_t nack = { .packet_type = NACK };
+    send_pkt(t, pid, &nack);
+    return 1;
+}
+
+void table_init(table_t *t, event_loop_t *loop, int id, const table_config_t *cfg)
+{
+    memset(t, 0, sizeof *t);
+    t->id = id;
+    t->loop = loop;
+    t->phase = TABLE_READY;
+    init_game_state(&t->game, cfg->starting_stack, cfg->seed);
+    t->game.table_id = id;
+    t->starting_stack = cfg->starting_stack;
+    t->action_ms = cfg->action_ms;
+    t->bank_ms = cfg->bank_ms;
+    t->start_ms = cfg->start_ms;
+    t->resume_ms = cfg->resume_ms;
+    t->timer_seat = -1;
+    feed_init(&t->feed, loop, cfg->max_watchers, cfg->watch_delay_ms);
+    EACH_PLAYER {
+        t->game.sockets[pid] = -1;
+        t->time_bank[pid] = cfg->bank_ms;
+    }
+}
+
+// a seat can be taken once its last player is gone for good, not just disconnected
+static int seat_free(table_t *t, player_id_t seat)
+{
+    return !t->conns[seat] && t->game.player_status[seat] == PLAYER_LEFT;
+}
+
+int table_seat(table_t *t, player_id_t seat, conn_t *c)
+{
+    int any = seat == ANY_SEAT;
+    if (any) {
+        EACH_PLAYER if (seat_free(t, pid)) {
+            seat = pid;
+            break;
+        }
+    }
+    if (t->phase == TABLE_HALTED || seat < 0 || seat >= MAX_PLAYERS || !seat_free(t, seat)) {
+        return -1;
+    }
+    if (getentropy(&t->tokens[seat], sizeof t->tokens[seat]) < 0) return -1;
+
+    game_state_t *g = &t->game;
+    attach(t, seat, c);
+    t->answered &= ~(1 << seat);
+    // whoever sat here before took their chips and cards along. a hand that is
+    // already being played goes on without the newcomer
+    g->player_stacks[seat] = t->starting_stack;
+    g->player_hands[seat][0] = g->player_hands[seat][1] = NOCARD;
+    g->player_status[seat] = t->phase == TABLE_BETTING ? PLAYER_FOLDED : PLAYER_ACTIVE;
+    t->time_bank[seat] = t->bank_ms;
+    ++g->num_players;
+
+    uint8_t frame[PROTO_MAX_FRAME];
+    if (any) conn_write(t->loop, c, frame, proto_encode_seated(seat, frame));
+    conn_write(t->loop, c, frame, proto_encode_session(t->tokens[seat], frame));
+    return seat;
+}
+
+// the last broadcast is the state of the hand, for a seat that missed it and maybe more
+static void send_snapshot(table_t *t, player_id_t pid)
+{
+    proto_public_t full;
+    proto_encode_info_public(NULL, &t->sent_public, &full);
+    t->info_synced |= 1 << pid;
+    send_info(t, pid, &full, t->game.player_hands[pid]);
+}
+
+int table_resume(table_t *t, player_id_t seat, uint64_t token, conn_t *c)
+{
+    if (t->phase == TABLE_HALTED || seat < 0 || seat >= MAX_PLAYERS) return -1;
+    // a seat whose window closed is only waiting for the hand to let it go
+    if (t->game.player_status[seat] == PLAYER_LEFT || (!t->conns[seat] && !(t->held & (1 << seat)))) return -1;
+    if (t->tokens[seat] != token) return -1;
+
+    // the old connection may not know yet that it is dead
+    conn_t *old = detach(t, seat);
+    if (old) conn_close(t->loop, old);
+    t->held &= ~(1 << seat);
+    loop_cancel_timer(t->loop, &t->resume_timer[seat]);
+    attach(t, seat, c);
+
+    uint8_t frame[PROTO_MAX_FRAME];
+    conn_write(t->loop, c, frame, proto_encode_session(token, frame));
+    if (t->phase == TABLE_BETTING) send_snapshot(t, seat);
+    return seat;
+}
+
+int table_watch(table_t *t, conn_t *c)
+{
+    if (t->phase == TABLE_HALTED || feed_add(&t->feed, c) < 0) return -1;
+    c->owner = t;
+    c->seat = -1;
+    return 0;
+}
+
+void table_data(table_t *t, conn_t *c)
+{
+    // spectators have nothing to say, they are only listened to for hanging up
+    if (c->seat < 0) {
+        feed_heard(&t->feed, c);
+        return;
+    }
+    table_pump(t);
+}
+
+void table_drained(table_t *t, conn_t *c)
+{
+    player_id_t pid = c->seat;
+    if (t->phase != TABLE_BETTING || pid < 0 || t->conns[pid] != c || (t->info_synced & (1 << pid))) return;
+    send_snapshot(t, pid);
+}
+
+void table_detach(table_t *t, conn_t *c)
+{
+    player_id_t pid = c->seat;
+    if (pid < 0) feed_remove(&t->feed, c);
+    if (pid < 0 || t->conns[pid] != c) {
+        c->owner = NULL;
+        return;
+    }
+    detach(t, pid);
+    if (t->resume_ms > 0 && t->phase != TABLE_HALTED && t->game.player_status[pid] != PLAYER_LEFT) hold_seat(t, pid);
+}
+
+
+// stops timing the current turn, charging the seat for the time bank it used
+static void stop_turn_timer(table_t *t)
+{
+    if (t->timer_seat < 0) return;
+    if (t->on_bank) {
+        int used = (int)(loop_now(t->loop) - t->bank_from);
+        int *bank = &t->time_bank[t->timer_seat];
+        *bank = used >= *bank ? 0 : *bank - used;
+    }
+    loop_cancel_timer(t->loop, &t->turn_timer);
+    t->timer_seat = -1;
+    t->on_bank = 0;
+}
+
+static void begin_street(table_t *t)
+{
+    memset(t->game.current_bets, 0, sizeof t->game.current_bets);
+    t->game.highest_bet = 0;
+
+    // with everyone else all in there is nobody left to bet against, the board is just
+    // run out, and it is nobody's turn
+    int active = count_active_players(t);
+    t->todo = active > 1 ? active : 0;
+    t->acted = 0;
+    t->game.current_player = t->todo ? next_active_player(t, t->game.dealer_player) : -1;
+}
+
+static void finish_hand(table_t *t)
+{
+    stop_turn_timer(t);
+    int winner = settle_pots(&t->game);
+    broadcast_end(t, winner);
+
+    // whoever is gone for good leaves with the hand
+    EACH_PLAYER if (abandoned(t, pid)) unseat(t, pid);
+
+    t->phase = TABLE_READY;
+    t->answered = 0;
+    t->ready = 0;
+}
+
+// deals streets until one needs a player to act, or the hand is over
+static void next_street(table_t *t)
+{
+    while (1) {
+        if (t->street >= 3) {
+            finish_hand(t);
+            return;
+        }
+
+        server_community(&t->game);
+        ++t->street;
+        begin_street(t);
+        broadcast_info(t);
+        if (t->acted < t->todo) return;
+    }
+}
+
+static void start_hand(table_t *t)
+{
+    game_state_t *g = &t->game;
+    loop_cancel_timer(t->loop, &t->start_timer);
+    // it takes two, whoever was ready may have left since
+    if (__builtin_popcount(t->ready) < 2) return;
+    reset_game_state(g);
+
+    // only the players who are ready are dealt in, everyone else seated sits this hand out
+    EACH_PLAYER {
+        if (g->player_status[pid] != PLAYER_LEFT && !(t->ready & (1 << pid))) {
+            g->player_status[pid] = PLAYER_FOLDED;
+        }
+    }
+
+    // the button moves on to the next player dealt in
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        g->dealer_player = NEXT(g->dealer_player);
+        if (g->player_status[g->dealer_player] == PLAYER_ACTIVE) break;
+    }
+
+    server_deal(g);
+    g->round_stage = ROUND_PREFLOP;
+    // every hand opens with a full snapshot, so no client stays out of step for long
+    t->info_synced = 0;
+    memset(g->current_bets, 0, sizeof g->current_bets);
+    g->highest_bet = 0;
+    g->current_player = next_active_player(t, g->dealer_player);
+    broadcast_info(t);
+
+    t->phase = TABLE_BETTING;
+    t->street = 0;
+    begin_street(t);
+    if (t->acted >= t->todo) next_street(t);
+}
+
+// moves the turn on after a valid action, ending the street or hand when it is over
+static void advance_turn(table_t *t)
+{
+    if (count_in_hand(t) <= 1) {
+        finish_hand(t);
+        return;
+    }
+    if (t->acted < t->todo) {
+        player_id_t next = next_active_player(t, t->game.current_player);
+        if (next >= 0) {
+            t->game.current_player = next;
+            broadcast_info(t);
+            return;
+        }
+    }
+    next_street(t);
+}
+
+// ack is 0 for actions the table takes on the player's behalf, they never asked for an answer
+static void on_action(table_t *t, player_id_t pid, const client_packet_t *cli, int ack)
+{
+    server_packet_t srv;
+    int valid = handle_client_action(&t->game, pid, cli, &srv);
+    if (ack) send_pkt(t, pid, &srv);
+
+    if (valid != 0) {
+        return;
+    }
+    stop_turn_timer(t);
+    if (cli->packet_type == RAISE) {
+        // everyone who can still bet answers the raise, a raiser who went all in cannot
+        t->todo = count_active_players(t);
+        t->acted = t->game.player_status[pid] == PLAYER_ACTIVE;
+    } else {
+        ++t->acted;
+    }
+    advance_turn(t);
+}
+
+// the current player hung up, their hand is folded and the seat is given up
+static void on_hangup(table_t *t, player_id_t pid)
+{
+    stop_turn_timer(t);
+    unseat(t, pid);
+    ++t->acted;
+    advance_turn(t);
+}
+
+// the table is done once the spectators, who may be behind, have seen it halt too
+static void on_feed_closed(void *arg)
+{
+    table_t *t = arg;
+    if (t->on_halt) t->on_halt(t);
+}
+
+static void halt_table(table_t *t)
+{
+    server_packet_t halt = { .packet_type = HALT };
+    uint8_t frame[PROTO_MAX_FRAME];
+    size_t len = broadcast(t, &halt, frame);
+    EACH_PLAYER if (t->conns[pid] || (t->held & (1 << pid))) unseat(t, pid);
+    stop_turn_timer(t);
+    loop_cancel_timer(t->loop, &t->start_timer);
+    t->phase = TABLE_HALTED;
+    feed_halt(&t->feed, frame, len, on_feed_closed, t);
+}
+
+static void on_turn_timeout(tw_timer_t *timer, void *arg)
+{
+    table_t *t = arg;
+    player_id_t pid = t->timer_seat;
+
+    // a dropped player's bank is theirs to use, the table only waits out the action time for them
+    if (!t->on_bank && t->time_bank[pid] > 0 && t->conns[pid]) {
+        t->on_bank = 1;
+        t->bank_from = loop_now(t->loop);
+        loop_timer(t->loop, &t->turn_timer, t->time_bank[pid], on_turn_timeout, t);
+        return;
+    }
+
+    // out of time, the table acts for the player: a free check, a fold otherwise
+    client_packet_t act = { .packet_type = FOLD };
+    if (t->game.current_bets[pid] == t->game.highest_bet) act.packet_type = CHECK;
+    on_action(t, pid, &act, 0);
+    table_pump(t);
+}
+
+// starts the clock on whoever the table now waits for, unless it already runs
+static void time_turn(table_t *t)
+{
+    if (t->phase != TABLE_BETTING || t->action_ms <= 0 || t->timer_seat >= 0) return;
+    t->timer_seat = t->game.current_player;
+    t->on_bank = 0;
+    loop_timer(t->loop, &t->turn_timer, t->action_ms, on_turn_timeout, t);
+}
+
+static void on_resume_timeout(tw_timer_t *timer, void *arg)
+{
+    table_t *t = arg;
+    player_id_t pid = timer - t->resume_timer;
+    t->held &= ~(1 << pid);
+
+    // a seat still in the hand is given up when its turn comes or the hand ends
+    if (t->phase != TABLE_BETTING || t->game.player_status[pid] == PLAYER_FOLDED) unseat(t, pid);
+    table_pump(t);
+}
+
+static void on_start_timeout(tw_timer_t *timer, void *arg)
+{
+    table_t *t = arg;
+    if (t->phase != TABLE_READY || __builtin_popcount(t->ready) < 2) return;
+
+    // the players still missing sit this one out
+    start_hand(t);
+    table_pump(t);
+}
+
+// once two players are ready, the others get start_ms to join them
+static void time_start(table_t *t)
+{
+    if (t->phase != TABLE_READY || t->start_ms <= 0 || __builtin_popcount(t->ready) < 2 || tw_armed(&t->start_timer)) return;
+    loop_timer(t->loop, &t->start_timer, t->start_ms, on_start_timeout, t);
+}
+
+static void on_ready_answer(table_t *t, player_id_t pid, const client_packet_t *in)
+{
+    t->answered |= 1 << pid;
+    if (!in || in->packet_type == LEAVE) {
+        server_packet_t ack = { .packet_type = ACK };
+        send_pkt(t, pid, &ack);
+        unseat(t, pid);
+        return;
+    }
+    // a player with no chips left can stay seated, but is not dealt in
+    if (in->packet_type == READY && t->game.player_stacks[pid] > 0) {
+        t->game.player_status[pid] = PLAYER_ACTIVE;
+        t->ready |= 1 << pid;
+    }
+}
+
+// every seated player has answered
+static int ready_phase_done(table_t *t)
+{
+    EACH_PLAYER if (t->conns[pid] && !(t->answered & (1 << pid))) return 0;
+    return 1;
+}
+
+// nobody else is expected once every seat has answered, or everyone who played the last hand has
+static int nobody_missing(table_t *t)
+{
+    return t->game.hand_number > 0 || t->answered == ALL_SEATS;
+}
+
+void table_pump(table_t *t)
+{
+    client_packet_t pkt;
+    int progress = 1;
+
+    // the resume window starts when a player drops, not when the table next waits on them
+    EACH_PLAYER if (t->conns[pid]) hold_if_dropped(t, pid);
+    while (progress) {
+        progress = 0;
+        EACH_PLAYER if (refuse_out_of_turn(t, pid)) progress = 1;
+
+        if (t->phase == TABLE_READY) {
+            EACH_PLAYER {
+                if (!t->conns[pid] || (t->answered & (1 << pid))) continue;
+                int got = take_packet(t, pid, &pkt);
+                if (got == 0) continue;
+                on_ready_answer(t, pid, got > 0 ? &pkt : NULL);
+                progress = 1;
+            }
+            if (ready_phase_done(t) && nobody_missing(t)) {
+                if (__builtin_popcount(t->ready) >= 2) {
+                    start_hand(t);
+                    progress = 1;
+                } else if (t->game.hand_number > 0) {
+                    // too few want another hand. before the first one the table waits for players instead
+                    halt_table(t);
+                    return;
+                }
+            }
+        } else if (t->phase == TABLE_BETTING) {
+            player_id_t pid = t->game.current_player;
+            if (t->conns[pid] && t->conns[pid]->congested) {
+                // a client that stopped reading does not know it is its turn, it sits this hand out
+                client_packet_t fold = { .packet_type = FOLD };
+                on_action(t, pid, &fold, 0);
+                progress = 1;
+                continue;
+            }
+            int got = take_packet(t, pid, &pkt);
+            if (got > 0) {
+                on_action(t, pid, &pkt, 1);
+                progress = 1;
+            } else if (got < 0) {
+                on_hangup(t, pid);
+                progress = 1;
+            }
+        }
+    }
+    time_turn(t);
+    time_start(t);
+}
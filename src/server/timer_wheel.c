@@ -0,0 +1,149 @@
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TW_SLOTS - 1)
+#define LEVEL_SHIFT(level) (TW_BITS * (level))
+#define MAX_SPAN (1ull << LEVEL_SHIFT(TW_LEVELS))
+
+static void unlink_timer(tw_timer_t *t)
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+// puts an unlinked timer in the slot its expiry falls in, seen from w->now
+static void place(timer_wheel_t *w, tw_timer_t *t)
+{
+    uint64_t expires = t->expires < w->now ? w->now : t->expires;
+    uint64_t delta = expires - w->now;
+    if (delta >= MAX_SPAN) {
+        // too far for the wheel, park it where it will be cascaded (and placed again) in time
+        expires = w->now + MAX_SPAN - 1;
+        delta = MAX_SPAN - 1;
+    }
+
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= (1ull << LEVEL_SHIFT(level + 1))) ++level;
+
+    tw_timer_t *head = &w->slots[level][(expires >> LEVEL_SHIFT(level)) & SLOT_MASK];
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+void tw_init(timer_wheel_t *w, uint64_t now)
+{
+    w->now = now;
+    w->count = 0;
+    for (int level = 0; level < TW_LEVELS; ++level) {
+        for (int slot = 0; slot < TW_SLOTS; ++slot) {
+            tw_timer_t *head = &w->slots[level][slot];
+            head->next = head->prev = head;
+        }
+    }
+}
+
+void tw_add(timer_wheel_t *w, tw_timer_t *t, uint64_t expires, tw_callback_t fn, void *arg)
+{
+    tw_cancel(w, t);
+    t->expires = expires;
+    t->fn = fn;
+    t->arg = arg;
+    place(w, t);
+    ++w->count;
+}
+
+void tw_cancel(timer_wheel_t *w, tw_timer_t *t)
+{
+    if (!tw_armed(t)) return;
+    unlink_timer(t);
+    --w->count;
+}
+
+// moves every timer of one slot down to the levels below
+static void cascade(timer_wheel_t *w, int level)
+{
+    tw_timer_t *head = &w->slots[level][(w->now >> LEVEL_SHIFT(level)) & SLOT_MASK];
+    tw_timer_t list = *head;
+    if (list.next == head) return;
+
+    // detach the whole list first, place() may put timers back in this very slot
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head->next = head->prev = head;
+
+    while (list.next != &list) {
+        tw_timer_t *t = list.next;
+        unlink_timer(t);
+        place(w, t);
+    }
+}
+
+/**
+ * the first tick from w->now on where anything happens: a timer fires, or a
+ * slot that holds timers is cascaded. UINT64_MAX if no timer is armed
+ */
+static uint64_t next_due(const timer_wheel_t *w)
+{
+    if (w->count == 0) return UINT64_MAX;
+
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < TW_SLOTS; ++i) {
+        const tw_timer_t *head = &w->slots[0][(w->now + i) & SLOT_MASK];
+        if (head->next != head) {
+            next = w->now + i;
+            break;
+        }
+    }
+
+    // a timer on a higher level is due no earlier than the cascade of its slot
+    for (int level = 1; level < TW_LEVELS; ++level) {
+        // the first cascade still to run, which is w->now itself if it is on a boundary
+        uint64_t span = 1ull << LEVEL_SHIFT(level);
+        uint64_t first = (w->now + span - 1) >> LEVEL_SHIFT(level);
+        for (int k = 0; k < TW_SLOTS; ++k) {
+            const tw_timer_t *head = &w->slots[level][(first + k) & SLOT_MASK];
+            if (head->next != head) {
+                uint64_t at = (first + k) << LEVEL_SHIFT(level);
+                if (at < next) next = at;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+void tw_advance(timer_wheel_t *w, uint64_t now)
+{
+    while (w->now <= now) {
+        // the ticks before the next one with something to do are empty, the clock jumps them
+        uint64_t due = next_due(w);
+        if (due > now) {
+            w->now = now + 1;
+            return;
+        }
+        w->now = due;
+
+        // from the top down, so nothing lands in a lower slot that was already cascaded
+        int top = 0;
+        while (top + 1 < TW_LEVELS && !(w->now & ((1ull << LEVEL_SHIFT(top + 1)) - 1))) ++top;
+        for (int level = top; level > 0; --level) cascade(w, level);
+
+        tw_timer_t *head = &w->slots[0][w->now & SLOT_MASK];
+        while (head->next != head) {
+            tw_timer_t *t = head->next;
+            unlink_timer(t);
+            --w->count;
+            t->fn(t, t->arg);
+        }
+        ++w->now;
+    }
+}
+
+int64_t tw_next_timeout(const timer_wheel_t *w, uint64_t now)
+{
+    uint64_t next = next_due(w);
+    if (next == UINT64_MAX) return -1;
+    return next <= now ? 0 : (int64_t)(next - now);
+}
@@ -0,0 +1,253 @@
+// syscall() and MAP_POPULATE are not part of POSIX
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "uring.h"
+
+struct uring {
+    int fd;
+    unsigned to_submit;                 // queued since the last io_uring_enter
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *ring;                         // the shared sq/cq ring mapping
+    size_t ring_size;
+    size_t sqes_size;
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+uring_t *uring_open(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+
+    int fd = sys_setup(entries, &p);
+    if (fd < 0) return NULL;
+
+    // one mapping for both rings, and timeouts passed straight to io_uring_enter
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        return NULL;
+    }
+
+    uring_t *r = calloc(1, sizeof *r);
+    if (!r) {
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    r->ring = mmap(NULL, r->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (r->ring == MAP_FAILED || r->sqes == MAP_FAILED) {
+        if (r->ring != MAP_FAILED) munmap(r->ring, r->ring_size);
+        if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+        close(fd);
+        free(r);
+        return NULL;
+    }
+
+    char *ring = r->ring;
+    r->sq_head = (unsigned *)(ring + p.sq_off.head);
+    r->sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(ring + p.sq_off.array);
+    r->sq_entries = p.sq_entries;
+
+    r->cq_head = (unsigned *)(ring + p.cq_off.head);
+    r->cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    return r;
+}
+
+void uring_close(uring_t *r)
+{
+    if (!r) return;
+    munmap(r->sqes, r->sqes_size);
+    munmap(r->ring, r->ring_size);
+    close(r->fd);
+    free(r);
+}
+
+int uring_register_buffer(uring_t *r, void *base, size_t len)
+{
+    struct iovec iov = { .iov_base = base, .iov_len = len };
+    return sys_register(r->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0 ? -1 : 0;
+}
+
+int uring_register_files(uring_t *r, unsigned count)
+{
+    int *fds = malloc(count * sizeof *fds);
+    if (!fds) return -1;
+    for (unsigned i = 0; i < count; ++i) fds[i] = -1;
+    int ret = sys_register(r->fd, IORING_REGISTER_FILES, fds, count);
+    free(fds);
+    return ret < 0 ? -1 : 0;
+}
+
+int uring_set_file(uring_t *r, unsigned slot, int fd)
+{
+    struct io_uring_files_update up = { .offset = slot, .fds = (uint64_t)(uintptr_t)&fd };
+    return sys_register(r->fd, IORING_REGISTER_FILES_UPDATE, &up, 1) < 0 ? -1 : 0;
+}
+
+// the next free submission entry, pushing the queue to the kernel if it is full
+static struct io_uring_sqe *get_sqe(uring_t *r)
+{
+    unsigned tail = *r->sq_tail;
+    while (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+        int n = sys_enter(r->fd, r->to_submit, 0, 0, NULL, 0);
+        if (n > 0) r->to_submit -= n;
+    }
+
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof *sqe);
+    r->sq_array[idx] = idx;
+    return sqe;
+}
+
+static void push_sqe(uring_t *r)
+{
+    __atomic_store_n(r->sq_tail, *r->sq_tail + 1, __ATOMIC_RELEASE);
+    ++r->to_submit;
+}
+
+static void prep_rw(uring_t *r, int op, int file, int fixed_file, const void *buf, size_t len, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(r);
+    sqe->opcode = op;
+    sqe->fd = file;
+    if (fixed_file) sqe->flags |= IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->user_data = user_data;
+    if (op == IORING_OP_SEND) sqe->msg_flags = MSG_NOSIGNAL;
+    push_sqe(r);
+}
+
+void uring_recv(uring_t *r, int file, int fixed_file, void *buf, size_t len, uint64_t user_data)
+{
+    prep_rw(r, IORING_OP_RECV, file, fixed_file, buf, len, user_data);
+}
+
+void uring_send(uring_t *r, int file, int fixed_file, const void *buf, size_t len, uint64_t user_data)
+{
+    prep_rw(r, IORING_OP_SEND, file, fixed_file, buf, len, user_data);
+}
+
+// the registered buffer is always index 0, which is what a zeroed sqe says
+void uring_read_fixed(uring_t *r, int file, int fixed_file, void *buf, size_t len, uint64_t user_data)
+{
+    prep_rw(r, IORING_OP_READ_FIXED, file, fixed_file, buf, len, user_data);
+}
+
+void uring_write_fixed(uring_t *r, int file, int fixed_file, const void *buf, size_t len, uint64_t user_data)
+{
+    prep_rw(r, IORING_OP_WRITE_FIXED, file, fixed_file, buf, len, user_data);
+}
+
+void uring_read(uring_t *r, int fd, void *buf, size_t len, uint64_t user_data)
+{
+    prep_rw(r, IORING_OP_READ, fd, 0, buf, len, user_data);
+}
+
+void uring_accept(uring_t *r, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(r);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+    push_sqe(r);
+}
+
+void uring_cancel(uring_t *r, uint64_t target, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(r);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+    push_sqe(r);
+}
+
+static int reap(uring_t *r, uring_cqe_t *out, int max)
+{
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    while (head != tail && n < max) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        out[n].user_data = cqe->user_data;
+        out[n].res = cqe->res;
+        ++n;
+        ++head;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+int uring_wait(uring_t *r, uring_cqe_t *out, int max, int timeout_ms)
+{
+    // completions that are already there need no waiting, only the submission
+    int n = reap(r, out, max);
+    unsigned min_complete = n > 0 ? 0 : 1;
+    if (n > 0 && r->to_submit == 0) return n;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof arg);
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    void *argp = NULL;
+    size_t argsz = 0;
+    if (timeout_ms >= 0 && min_complete) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof arg;
+    }
+
+    int ret = sys_enter(r->fd, r->to_submit, min_complete, flags, argp, argsz);
+    if (ret > 0) r->to_submit -= ret;
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) return n;
+
+    return n + reap(r, out + n, max - n);
+}
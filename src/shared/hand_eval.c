@@ -0,0 +1,611 @@
+#include "hand_eval.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/**
+ * table driven hand evaluator
+ *
+ * a hand either contains a flush or it does not. if five or more cards share a
+ * suit, then (with at most 7 cards) nothing but a flush or straight flush can
+ * beat it, so its score only depends on the 13 bit rank mask of that suit.
+ * otherwise the suits are irrelevant and the score only depends on how many
+ * cards of each rank there are.
+ *
+ * both cases are precomputed:
+ *  - flush_table is indexed directly by the 13 bit rank mask of the flush suit
+ *  - noflush_table is indexed by a perfect hash of the rank histogram. the
+ *    histogram is read as a base-5 number (0-4 cards of each rank) and ranked
+ *    among all histograms holding the same number of cards, giving a dense
+ *    index (49205 entries for 7 cards)
+ *
+ * so an evaluation is one pass over the cards followed by 13 small table loads.
+ *
+ * hand_eval_set works on a cardset_t instead. the rank masks of cards held at
+ * least once, twice, three and four times fall out of and/or-ing the four suite
+ * lanes, and every category is scored from those masks with rank_table and
+ * straight_table. invalid categories are masked to 0 and the best score is the
+ * largest one left, so nothing branches on the cards themselves.
+ *
+ * evaluate_hands_batch runs that same sequence of masks and table loads over 8
+ * (AVX2) or 4 (SSE4.1) hands at once, one hand per 32 bit vector lane.
+ */
+
+#define NUM_RANKS 13
+#define NUM_SUITS 4
+#define MAX_OF_RANK 4
+
+#define NOFLUSH_TABLE_SIZE 76155 // histograms of 0 to 7 cards
+#define WHEEL_MASK 0x100f        // A 5 4 3 2
+
+#define SCORE(category, detail) (((category) << HAND_CATEGORY_SHIFT) | (detail))
+
+#define RANK_BIT(rank) (1 << (rank))
+#define TOP_RANK(mask) (rank_table[mask] >> 16)
+#define KEEP_IF(cond, score) ((score) & -(int)((cond) != 0))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// multiset_count[n][k]: ways to spread k cards over n ranks with at most 4 per rank
+static int multiset_count[NUM_RANKS + 1][MAX_EVAL_CARDS + 1];
+// quinary_offset[r][q][k]: how many histograms are ranked before having q cards
+// of rank r when k cards are still left to place on ranks r..12
+static int quinary_offset[NUM_RANKS][MAX_OF_RANK + 1][MAX_EVAL_CARDS + 1];
+// index of the first histogram holding k cards
+static int table_base[MAX_EVAL_CARDS + 1];
+
+static int noflush_table[NOFLUSH_TABLE_SIZE];
+static int flush_table[1 << NUM_RANKS];
+// the 5 highest ranks of a rank mask, packed 4 bits each (0 padded)
+static int rank_table[1 << NUM_RANKS];
+// the straight score of a rank mask, or 0 if it holds no straight
+static int straight_table[1 << NUM_RANKS];
+
+static int tables_ready = 0;
+
+typedef void (*batch_kernel_t)(cardset_t board, const card_t holes[][HOLE_CARDS], int n, int *scores);
+
+static void batch_scalar(cardset_t board, const card_t holes[][HOLE_CARDS], int n, int *scores);
+static batch_kernel_t batch_kernel = batch_scalar;
+static const char *batch_kernel_name = "scalar";
+
+static int pack_detail(const int *vals, int n) {
+    int out = 0;
+    for (int i = 0; i < n; ++i) {
+        out = (out << 4) | vals[i];
+    }
+    return out;
+}
+
+static int straight_top(int mask) {
+    for (int top = NUM_RANKS - 1; top >= 4; --top) {
+        if (((mask >> (top - 4)) & 0x1f) == 0x1f) {
+            return top;
+        }
+    }
+    if ((mask & WHEEL_MASK) == WHEEL_MASK) {
+        return RANK(FIVE);
+    }
+    return -1;
+}
+
+// fills out[] with the n highest ranks present, skipping the given ranks
+static void top_ranks(const unsigned char *cnt, int skip1, int skip2, int *out, int n) {
+    int k = 0;
+    for (int r = NUM_RANKS - 1; r >= 0 && k < n; --r) {
+        if (cnt[r] && r != skip1 && r != skip2) {
+            out[k++] = r;
+        }
+    }
+    while (k < n) {
+        out[k++] = 0;
+    }
+}
+
+static int score_flush(int mask) {
+    int top = straight_top(mask);
+    if (top >= 0) {
+        return SCORE(STRAIGHT_FLUSH, top << 16);
+    }
+
+    int vals[5];
+    int k = 0;
+    for (int r = NUM_RANKS - 1; r >= 0 && k < 5; --r) {
+        if (mask & (1 << r)) {
+            vals[k++] = r;
+        }
+    }
+    return SCORE(FLUSH, pack_detail(vals, 5));
+}
+
+static int score_ranks(const unsigned char *cnt) {
+    int mask = 0;
+    int quad = -1;
+    int three = -1;
+    int p1 = -1;
+    int p2 = -1;
+
+    for (int r = NUM_RANKS - 1; r >= 0; --r) {
+        if (!cnt[r]) {
+            continue;
+        }
+        mask |= 1 << r;
+        if (cnt[r] == 4 && quad < 0) {
+            quad = r;
+        } else if (cnt[r] >= 3 && three < 0) {
+            three = r;
+        } else if (cnt[r] >= 2) {
+            if (p1 < 0) {
+                p1 = r;
+            } else if (p2 < 0) {
+                p2 = r;
+            }
+        }
+    }
+
+    int kick[5];
+    if (quad >= 0) {
+        top_ranks(cnt, quad, -1, kick, 1);
+        return SCORE(FOUR_OF_A_KIND, (quad << 16) | (kick[0] << 12));
+    }
+    if (three >= 0 && p1 >= 0) {
+        return SCORE(FULL_HOUSE, (three << 16) | (p1 << 12));
+    }
+
+    int top = straight_top(mask);
+    if (top >= 0) {
+        return SCORE(STRAIGHT, top << 16);
+    }
+
+    if (three >= 0) {
+        top_ranks(cnt, three, -1, kick, 2);
+        return SCORE(THREE_OF_A_KIND, (three << 16) | pack_detail(kick, 2));
+    }
+    if (p2 >= 0) {
+        top_ranks(cnt, p1, p2, kick, 1);
+        int tmp[3] = {p1, p2, kick[0]};
+        return SCORE(TWO_PAIR, pack_detail(tmp, 3));
+    }
+    if (p1 >= 0) {
+        top_ranks(cnt, p1, -1, kick, 3);
+        int tmp[4] = {p1, kick[0], kick[1], kick[2]};
+        return SCORE(ONE_PAIR, pack_detail(tmp, 4));
+    }
+
+    top_ranks(cnt, -1, -1, kick, 5);
+    return SCORE(HIGH_CARD, pack_detail(kick, 5));
+}
+
+static int hash_quinary(const unsigned char *cnt, int k) {
+    int sum = 0;
+    for (int r = 0; r < NUM_RANKS; ++r) {
+        sum += quinary_offset[r][cnt[r]][k];
+        k -= cnt[r];
+    }
+    return sum;
+}
+
+// walks every histogram of `left` more cards over ranks r..12
+static void fill_noflush(unsigned char *cnt, int r, int left, int total) {
+    if (r == NUM_RANKS) {
+        if (left == 0) {
+            noflush_table[table_base[total] + hash_quinary(cnt, total)] = score_ranks(cnt);
+        }
+        return;
+    }
+    for (int q = 0; q <= MAX_OF_RANK && q <= left; ++q) {
+        cnt[r] = q;
+        fill_noflush(cnt, r + 1, left - q, total);
+    }
+    cnt[r] = 0;
+}
+
+static void batch_scalar(cardset_t board, const card_t holes[][HOLE_CARDS], int n, int *scores) {
+    for (int i = 0; i < n; ++i) {
+        scores[i] = hand_eval_set(board | cardset_of(holes[i], HOLE_CARDS));
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// runs a kernel over a short tail padded out to a full block of NOCARD hands
+#define BATCH_TAIL(kernel, width, board, holes, n, scores)                   \
+    do {                                                                     \
+        card_t pad[width][HOLE_CARDS];                                       \
+        int out[width];                                                      \
+        memset(pad, NOCARD, sizeof pad);                                     \
+        memcpy(pad, holes, (n) * sizeof *pad);                               \
+        kernel(board, pad, width, out);                                      \
+        memcpy(scores, out, (n) * sizeof *out);                              \
+    } while (0)
+
+__attribute__((target("avx2")))
+static inline __m256i top_rank8(__m256i mask) {
+    return _mm256_srli_epi32(_mm256_i32gather_epi32(rank_table, mask, 4), 16);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i keep_if8(__m256i cond, __m256i score) {
+    return _mm256_andnot_si256(_mm256_cmpeq_epi32(cond, _mm256_setzero_si256()), score);
+}
+
+__attribute__((target("avx2")))
+static void batch_avx2(cardset_t board, const card_t holes[][HOLE_CARDS], int n, int *scores) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i four = _mm256_set1_epi32(4);
+    const __m256i no_card = _mm256_set1_epi32(NOCARD);
+    const __m256i suite_mask = _mm256_set1_epi32((1 << SUITE_BITS) - 1);
+    const __m256i stride = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+
+    __m256i board_lane[NUM_SUITS];
+    __m256i board_cnt[NUM_SUITS];
+    for (int s = 0; s < NUM_SUITS; ++s) {
+        board_lane[s] = _mm256_set1_epi32(SUITE_LANE(board, s));
+        board_cnt[s] = _mm256_set1_epi32(__builtin_popcount(SUITE_LANE(board, s)));
+    }
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i c0 = _mm256_i32gather_epi32(&holes[i][0], stride, 4);
+        __m256i c1 = _mm256_i32gather_epi32(&holes[i][1], stride, 4);
+        __m256i valid0 = _mm256_cmpgt_epi32(c0, no_card);
+        __m256i valid1 = _mm256_cmpgt_epi32(c1, no_card);
+        __m256i bit0 = _mm256_and_si256(_mm256_sllv_epi32(one, _mm256_srai_epi32(c0, SUITE_BITS)), valid0);
+        __m256i bit1 = _mm256_and_si256(_mm256_sllv_epi32(one, _mm256_srai_epi32(c1, SUITE_BITS)), valid1);
+        __m256i s0 = _mm256_and_si256(c0, suite_mask);
+        __m256i s1 = _mm256_and_si256(c1, suite_mask);
+
+        __m256i lane[NUM_SUITS];
+        __m256i flush = _mm256_setzero_si256();
+        for (int s = 0; s < NUM_SUITS; ++s) {
+            __m256i suite = _mm256_set1_epi32(s);
+            __m256i m0 = _mm256_and_si256(_mm256_cmpeq_epi32(s0, suite), valid0);
+            __m256i m1 = _mm256_and_si256(_mm256_cmpeq_epi32(s1, suite), valid1);
+            lane[s] = _mm256_or_si256(board_lane[s],
+                      _mm256_or_si256(_mm256_and_si256(bit0, m0), _mm256_and_si256(bit1, m1)));
+            __m256i cnt = _mm256_sub_epi32(_mm256_sub_epi32(board_cnt[s], m0), m1);
+            flush = _mm256_or_si256(flush, _mm256_and_si256(lane[s], _mm256_cmpgt_epi32(cnt, four)));
+        }
+
+        __m256i d = lane[DIAMOND], c = lane[CLUB], h = lane[HEART], sp = lane[SPADE];
+        __m256i dc = _mm256_and_si256(d, c);
+        __m256i hs = _mm256_and_si256(h, sp);
+        __m256i d_or_c = _mm256_or_si256(d, c);
+        __m256i h_or_s = _mm256_or_si256(h, sp);
+        __m256i ranks = _mm256_or_si256(d_or_c, h_or_s);
+        __m256i two = _mm256_or_si256(_mm256_or_si256(dc, hs), _mm256_and_si256(d_or_c, h_or_s));
+        __m256i three = _mm256_or_si256(_mm256_and_si256(dc, h_or_s), _mm256_and_si256(hs, d_or_c));
+        __m256i quad = _mm256_and_si256(dc, hs);
+
+        __m256i p = top_rank8(two);
+        __m256i two_rest = _mm256_andnot_si256(_mm256_sllv_epi32(one, p), two);
+        __m256i p2 = top_rank8(two_rest);
+        __m256i t = top_rank8(three);
+        __m256i tp_mask = _mm256_andnot_si256(_mm256_sllv_epi32(one, t), two);
+        __m256i tp = top_rank8(tp_mask);
+        __m256i q = top_rank8(quad);
+        __m256i no_p = _mm256_andnot_si256(_mm256_sllv_epi32(one, p), ranks);
+        __m256i no_p2 = _mm256_andnot_si256(_mm256_sllv_epi32(one, p2), no_p);
+        __m256i no_t = _mm256_andnot_si256(_mm256_sllv_epi32(one, t), ranks);
+        __m256i no_q = _mm256_andnot_si256(_mm256_sllv_epi32(one, q), ranks);
+
+        __m256i best = _mm256_i32gather_epi32(rank_table, ranks, 4);
+        __m256i pair = _mm256_or_si256(_mm256_set1_epi32(SCORE(ONE_PAIR, 0)),
+            _mm256_or_si256(_mm256_slli_epi32(p, 12),
+                            _mm256_srli_epi32(_mm256_i32gather_epi32(rank_table, no_p, 4), 8)));
+        best = _mm256_max_epi32(best, keep_if8(two, pair));
+        __m256i two_pair = _mm256_or_si256(_mm256_set1_epi32(SCORE(TWO_PAIR, 0)),
+            _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(p, 8), _mm256_slli_epi32(p2, 4)),
+                            top_rank8(no_p2)));
+        best = _mm256_max_epi32(best, keep_if8(two_rest, two_pair));
+        __m256i trips = _mm256_or_si256(_mm256_set1_epi32(SCORE(THREE_OF_A_KIND, 0)),
+            _mm256_or_si256(_mm256_slli_epi32(t, 16),
+                            _mm256_srli_epi32(_mm256_i32gather_epi32(rank_table, no_t, 4), 12)));
+        best = _mm256_max_epi32(best, keep_if8(three, trips));
+        best = _mm256_max_epi32(best, _mm256_i32gather_epi32(straight_table, ranks, 4));
+        __m256i full = _mm256_or_si256(_mm256_set1_epi32(SCORE(FULL_HOUSE, 0)),
+            _mm256_or_si256(_mm256_slli_epi32(t, 16), _mm256_slli_epi32(tp, 12)));
+        best = _mm256_max_epi32(best, keep_if8(three, keep_if8(tp_mask, full)));
+        __m256i quads = _mm256_or_si256(_mm256_set1_epi32(SCORE(FOUR_OF_A_KIND, 0)),
+            _mm256_or_si256(_mm256_slli_epi32(q, 16), _mm256_slli_epi32(top_rank8(no_q), 12)));
+        best = _mm256_max_epi32(best, keep_if8(quad, quads));
+        best = _mm256_max_epi32(best, _mm256_i32gather_epi32(flush_table, flush, 4));
+
+        _mm256_storeu_si256((__m256i *)(scores + i), best);
+    }
+
+    if (i < n) {
+        BATCH_TAIL(batch_avx2, 8, board, holes + i, n - i, scores + i);
+    }
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i gather4(const int *table, __m128i idx) {
+    return _mm_setr_epi32(table[_mm_extract_epi32(idx, 0)], table[_mm_extract_epi32(idx, 1)],
+                          table[_mm_extract_epi32(idx, 2)], table[_mm_extract_epi32(idx, 3)]);
+}
+
+// 1 << r for r in [0, 30], and 0 for r < 0, built from the float 2^r
+__attribute__((target("sse4.1")))
+static inline __m128i rank_bit4(__m128i r) {
+    __m128i exponent = _mm_slli_epi32(_mm_add_epi32(r, _mm_set1_epi32(127)), 23);
+    return _mm_cvttps_epi32(_mm_castsi128_ps(exponent));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i top_rank4(__m128i mask) {
+    return _mm_srli_epi32(gather4(rank_table, mask), 16);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i keep_if4(__m128i cond, __m128i score) {
+    return _mm_andnot_si128(_mm_cmpeq_epi32(cond, _mm_setzero_si128()), score);
+}
+
+__attribute__((target("sse4.1")))
+static void batch_sse4(cardset_t board, const card_t holes[][HOLE_CARDS], int n, int *scores) {
+    const __m128i four = _mm_set1_epi32(4);
+    const __m128i no_card = _mm_set1_epi32(NOCARD);
+    const __m128i suite_mask = _mm_set1_epi32((1 << SUITE_BITS) - 1);
+
+    __m128i board_lane[NUM_SUITS];
+    __m128i board_cnt[NUM_SUITS];
+    for (int s = 0; s < NUM_SUITS; ++s) {
+        board_lane[s] = _mm_set1_epi32(SUITE_LANE(board, s));
+        board_cnt[s] = _mm_set1_epi32(__builtin_popcount(SUITE_LANE(board, s)));
+    }
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 lo = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)&holes[i][0]));
+        __m128 hi = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)&holes[i + 2][0]));
+        __m128i c0 = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i c1 = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i valid0 = _mm_cmpgt_epi32(c0, no_card);
+        __m128i valid1 = _mm_cmpgt_epi32(c1, no_card);
+        __m128i bit0 = _mm_and_si128(rank_bit4(_mm_srai_epi32(c0, SUITE_BITS)), valid0);
+        __m128i bit1 = _mm_and_si128(rank_bit4(_mm_srai_epi32(c1, SUITE_BITS)), valid1);
+        __m128i s0 = _mm_and_si128(c0, suite_mask);
+        __m128i s1 = _mm_and_si128(c1, suite_mask);
+
+        __m128i lane[NUM_SUITS];
+        __m128i flush = _mm_setzero_si128();
+        for (int s = 0; s < NUM_SUITS; ++s) {
+            __m128i suite = _mm_set1_epi32(s);
+            __m128i m0 = _mm_and_si128(_mm_cmpeq_epi32(s0, suite), valid0);
+            __m128i m1 = _mm_and_si128(_mm_cmpeq_epi32(s1, suite), valid1);
+            lane[s] = _mm_or_si128(board_lane[s],
+                      _mm_or_si128(_mm_and_si128(bit0, m0), _mm_and_si128(bit1, m1)));
+            __m128i cnt = _mm_sub_epi32(_mm_sub_epi32(board_cnt[s], m0), m1);
+            flush = _mm_or_si128(flush, _mm_and_si128(lane[s], _mm_cmpgt_epi32(cnt, four)));
+        }
+
+        __m128i d = lane[DIAMOND], c = lane[CLUB], h = lane[HEART], sp = lane[SPADE];
+        __m128i dc = _mm_and_si128(d, c);
+        __m128i hs = _mm_and_si128(h, sp);
+        __m128i d_or_c = _mm_or_si128(d, c);
+        __m128i h_or_s = _mm_or_si128(h, sp);
+        __m128i ranks = _mm_or_si128(d_or_c, h_or_s);
+        __m128i two = _mm_or_si128(_mm_or_si128(dc, hs), _mm_and_si128(d_or_c, h_or_s));
+        __m128i three = _mm_or_si128(_mm_and_si128(dc, h_or_s), _mm_and_si128(hs, d_or_c));
+        __m128i quad = _mm_and_si128(dc, hs);
+
+        __m128i p = top_rank4(two);
+        __m128i two_rest = _mm_andnot_si128(rank_bit4(p), two);
+        __m128i p2 = top_rank4(two_rest);
+        __m128i t = top_rank4(three);
+        __m128i tp_mask = _mm_andnot_si128(rank_bit4(t), two);
+        __m128i tp = top_rank4(tp_mask);
+        __m128i q = top_rank4(quad);
+        __m128i no_p = _mm_andnot_si128(rank_bit4(p), ranks);
+        __m128i no_p2 = _mm_andnot_si128(rank_bit4(p2), no_p);
+        __m128i no_t = _mm_andnot_si128(rank_bit4(t), ranks);
+        __m128i no_q = _mm_andnot_si128(rank_bit4(q), ranks);
+
+        __m128i best = gather4(rank_table, ranks);
+        __m128i pair = _mm_or_si128(_mm_set1_epi32(SCORE(ONE_PAIR, 0)),
+            _mm_or_si128(_mm_slli_epi32(p, 12), _mm_srli_epi32(gather4(rank_table, no_p), 8)));
+        best = _mm_max_epi32(best, keep_if4(two, pair));
+        __m128i two_pair = _mm_or_si128(_mm_set1_epi32(SCORE(TWO_PAIR, 0)),
+            _mm_or_si128(_mm_or_si128(_mm_slli_epi32(p, 8), _mm_slli_epi32(p2, 4)), top_rank4(no_p2)));
+        best = _mm_max_epi32(best, keep_if4(two_rest, two_pair));
+        __m128i trips = _mm_or_si128(_mm_set1_epi32(SCORE(THREE_OF_A_KIND, 0)),
+            _mm_or_si128(_mm_slli_epi32(t, 16), _mm_srli_epi32(gather4(rank_table, no_t), 12)));
+        best = _mm_max_epi32(best, keep_if4(three, trips));
+        best = _mm_max_epi32(best, gather4(straight_table, ranks));
+        __m128i full = _mm_or_si128(_mm_set1_epi32(SCORE(FULL_HOUSE, 0)),
+            _mm_or_si128(_mm_slli_epi32(t, 16), _mm_slli_epi32(tp, 12)));
+        best = _mm_max_epi32(best, keep_if4(three, keep_if4(tp_mask, full)));
+        __m128i quads = _mm_or_si128(_mm_set1_epi32(SCORE(FOUR_OF_A_KIND, 0)),
+            _mm_or_si128(_mm_slli_epi32(q, 16), _mm_slli_epi32(top_rank4(no_q), 12)));
+        best = _mm_max_epi32(best, keep_if4(quad, quads));
+        best = _mm_max_epi32(best, gather4(flush_table, flush));
+
+        _mm_storeu_si128((__m128i *)(scores + i), best);
+    }
+
+    if (i < n) {
+        BATCH_TAIL(batch_sse4, 4, board, holes + i, n - i, scores + i);
+    }
+}
+
+#endif
+
+void hand_eval_init(void) {
+    if (tables_ready) {
+        return;
+    }
+
+    multiset_count[0][0] = 1;
+    for (int n = 1; n <= NUM_RANKS; ++n) {
+        for (int k = 0; k <= MAX_EVAL_CARDS; ++k) {
+            for (int q = 0; q <= MAX_OF_RANK && q <= k; ++q) {
+                multiset_count[n][k] += multiset_count[n - 1][k - q];
+            }
+        }
+    }
+
+    for (int r = 0; r < NUM_RANKS; ++r) {
+        int rest = NUM_RANKS - 1 - r;
+        for (int k = 0; k <= MAX_EVAL_CARDS; ++k) {
+            int acc = 0;
+            for (int q = 0; q <= MAX_OF_RANK; ++q) {
+                quinary_offset[r][q][k] = acc;
+                if (q <= k) {
+                    acc += multiset_count[rest][k - q];
+                }
+            }
+        }
+    }
+
+    int base = 0;
+    for (int k = 0; k <= MAX_EVAL_CARDS; ++k) {
+        table_base[k] = base;
+        base += multiset_count[NUM_RANKS][k];
+    }
+
+    unsigned char cnt[NUM_RANKS] = {0};
+    for (int k = 0; k <= MAX_EVAL_CARDS; ++k) {
+        fill_noflush(cnt, 0, k, k);
+    }
+
+    for (int mask = 0; mask < (1 << NUM_RANKS); ++mask) {
+        flush_table[mask] = (__builtin_popcount(mask) >= 5) ? score_flush(mask) : 0;
+
+        int vals[5];
+        unsigned char present[NUM_RANKS];
+        for (int r = 0; r < NUM_RANKS; ++r) {
+            present[r] = (mask >> r) & 1;
+        }
+        top_ranks(present, -1, -1, vals, 5);
+        rank_table[mask] = pack_detail(vals, 5);
+
+        int top = straight_top(mask);
+        straight_table[mask] = (top >= 0) ? SCORE(STRAIGHT, top << 16) : 0;
+    }
+
+#ifdef HAVE_X86_KERNELS
+    if (hand_eval_use_kernel("avx2") < 0) {
+        hand_eval_use_kernel("sse4");
+    }
+#endif
+
+    tables_ready = 1;
+}
+
+void hand_state_clear(hand_state_t *st) {
+    memset(st, 0, sizeof *st);
+}
+
+void hand_state_add(hand_state_t *st, card_t card) {
+    st->cards |= CARD_BIT(card);
+    ++st->rank_count[RANK(card)];
+    ++st->suite_count[SUITE(card)];
+    ++st->count;
+}
+
+int hand_eval_state(const hand_state_t *st) {
+    for (int s = 0; s < NUM_SUITS; ++s) {
+        if (st->suite_count[s] >= 5) {
+            return flush_table[SUITE_LANE(st->cards, s)];
+        }
+    }
+    return noflush_table[table_base[st->count] + hash_quinary(st->rank_count, st->count)];
+}
+
+int hand_eval(const card_t *cards, int count) {
+    hand_state_t st;
+    hand_state_clear(&st);
+    for (int i = 0; i < count; ++i) {
+        hand_state_add(&st, cards[i]);
+    }
+    return hand_eval_state(&st);
+}
+
+cardset_t cardset_of(const card_t *cards, int count) {
+    cardset_t set = 0;
+    for (int i = 0; i < count; ++i) {
+        if (cards[i] != NOCARD) {
+            set |= CARD_BIT(cards[i]);
+        }
+    }
+    return set;
+}
+
+int hand_eval_set(cardset_t set) {
+    int d = SUITE_LANE(set, DIAMOND);
+    int c = SUITE_LANE(set, CLUB);
+    int h = SUITE_LANE(set, HEART);
+    int s = SUITE_LANE(set, SPADE);
+
+    // ranks held at least once / twice / three times / four times
+    int ranks = d | c | h | s;
+    int two   = (d & c) | (h & s) | ((d | c) & (h | s));
+    int three = ((d & c) & (h | s)) | ((h & s) & (d | c));
+    int four  = d & c & h & s;
+
+    int p  = TOP_RANK(two);
+    int p2 = TOP_RANK(two & ~RANK_BIT(p));
+    int t  = TOP_RANK(three);
+    int tp = TOP_RANK(two & ~RANK_BIT(t));
+    int q  = TOP_RANK(four);
+
+    int best = SCORE(HIGH_CARD, rank_table[ranks]);
+    best = MAX(best, KEEP_IF(two,
+        SCORE(ONE_PAIR, (p << 12) | (rank_table[ranks & ~RANK_BIT(p)] >> 8))));
+    best = MAX(best, KEEP_IF(two & ~RANK_BIT(p),
+        SCORE(TWO_PAIR, (p << 8) | (p2 << 4) | TOP_RANK(ranks & ~RANK_BIT(p) & ~RANK_BIT(p2)))));
+    best = MAX(best, KEEP_IF(three,
+        SCORE(THREE_OF_A_KIND, (t << 16) | (rank_table[ranks & ~RANK_BIT(t)] >> 12))));
+    best = MAX(best, straight_table[ranks]);
+    best = MAX(best, KEEP_IF((three != 0) & ((two & ~RANK_BIT(t)) != 0),
+        SCORE(FULL_HOUSE, (t << 16) | (tp << 12))));
+    best = MAX(best, KEEP_IF(four,
+        SCORE(FOUR_OF_A_KIND, (q << 16) | (TOP_RANK(ranks & ~RANK_BIT(q)) << 12))));
+
+    // with at most 7 cards only one lane can hold a flush, and a flush beats
+    // anything the other lanes could add
+    int flush = (d & -(__builtin_popcount(d) >= 5)) | (c & -(__builtin_popcount(c) >= 5))
+              | (h & -(__builtin_popcount(h) >= 5)) | (s & -(__builtin_popcount(s) >= 5));
+    return MAX(best, flush_table[flush]);
+}
+
+void evaluate_hands_batch(const card_t board[BOARD_CARDS], const card_t holes[][HOLE_CARDS], int n, int *scores) {
+    batch_kernel(cardset_of(board, BOARD_CARDS), holes, n, scores);
+}
+
+const char *hand_eval_kernel(void) {
+    return batch_kernel_name;
+}
+
+int hand_eval_use_kernel(const char *name) {
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+#endif
+    const struct {
+        const char *name;
+        int supported;
+        batch_kernel_t kernel;
+    } kernels[] = {
+        { "scalar", 1, batch_scalar },
+#ifdef HAVE_X86_KERNELS
+        { "sse4", __builtin_cpu_supports("sse4.1"), batch_sse4 },
+        { "avx2", __builtin_cpu_supports("avx2"), batch_avx2 },
+#endif
+    };
+
+    for (size_t i = 0; i < sizeof kernels / sizeof kernels[0]; ++i) {
+        if (strcmp(kernels[i].name, name) == 0) {
+            if (!kernels[i].supported) {
+                return -1;
+            }
+            batch_kernel = kernels[i].kernel;
+            batch_kernel_name = kernels[i].name;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -35,6 +35,31 @@ void log_player_init(int num)
     log_file = fopen(filename, "w");
 }
 
+void log_table_player_init(int table, int num)
+{
+    if (table == 0)
+    {
+        log_player_init(num);
+        return;
+    }
+
+    char filename[MAX_FILE_LEN] = { 0 };
+    snprintf(filename, MAX_FILE_LEN, LOG_DIR "table%d.player%d.logs", table, num);
+
+    log_file = fopen(filename, "w");
+}
+
+void log_table_spectator_init(int table, int num)
+{
+    char filename[MAX_FILE_LEN] = { 0 };
+    if (table == 0)
+        snprintf(filename, MAX_FILE_LEN, LOG_DIR "spectator%d.logs", num);
+    else
+        snprintf(filename, MAX_FILE_LEN, LOG_DIR "table%d.spectator%d.logs", table, num);
+
+    log_file = fopen(filename, "w");
+}
+
 void log_info(const char *fmt_str, ...)
 {
     if (log_file)
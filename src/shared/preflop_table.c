@@ -0,0 +1,56 @@
+#include "preflop_table.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const preflop_table_t *preflop_table_open(const char *path)
+{
+    if (!path) path = getenv(PREFLOP_TABLE_ENV);
+    if (!path) path = PREFLOP_TABLE_PATH;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size != sizeof(preflop_table_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, sizeof(preflop_table_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const preflop_table_t *table = map;
+    if (table->magic != PREFLOP_MAGIC || table->version != PREFLOP_VERSION ||
+        table->num_classes != PREFLOP_CLASSES || table->max_opponents != PREFLOP_MAX_OPPONENTS)
+    {
+        munmap(map, sizeof(preflop_table_t));
+        return NULL;
+    }
+    return table;
+}
+
+void preflop_table_close(const preflop_table_t *table)
+{
+    if (table) munmap((void *)table, sizeof(preflop_table_t));
+}
+
+int preflop_class(card_t c0, card_t c1)
+{
+    int hi = RANK(c0) > RANK(c1) ? RANK(c0) : RANK(c1);
+    int lo = RANK(c0) > RANK(c1) ? RANK(c1) : RANK(c0);
+    if (SUITE(c0) == SUITE(c1)) return hi * 13 + lo;
+    return lo * 13 + hi;
+}
+
+double preflop_equity(const preflop_table_t *table, card_t c0, card_t c1, int opponents)
+{
+    if (opponents < 1) opponents = 1;
+    if (opponents > PREFLOP_MAX_OPPONENTS) opponents = PREFLOP_MAX_OPPONENTS;
+    return table->equity[preflop_class(c0, c1)][opponents - 1] / 65535.0;
+}
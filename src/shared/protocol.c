@@ -0,0 +1,517 @@
+#include <string.h>
+
+#include "protocol.h"
+
+#define NO_CARD_BYTE 0xff
+#define STATUS_BITS 2
+
+// the fields of an info delta, one bit each in its mask
+#define D_BOARD     (1u << 0)
+#define D_POT       (1u << 1)
+#define D_DEALER    (1u << 2)
+#define D_TURN      (1u << 3)
+#define D_BET       (1u << 4)
+#define D_STATUS    (1u << 5)
+#define D_STACK(i)  (1u << (6 + (i)))
+#define D_BETS(i)   (1u << (6 + MAX_PLAYERS + (i)))
+#define D_ALL       ((1u << (6 + 2 * MAX_PLAYERS)) - 1)
+
+typedef struct {
+    uint8_t *p;
+} writer_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    int bad;                            // read past the end, or a value that cannot be right
+} reader_t;
+
+// ---------------------------- writing ---------------------------- //
+
+static void put_u8(writer_t *w, uint8_t v) {
+    *w->p++ = v;
+}
+
+static void put_uvarint(writer_t *w, uint32_t v) {
+    while (v >= 0x80) {
+        put_u8(w, (uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    put_u8(w, (uint8_t)v);
+}
+
+// zigzag keeps small negative numbers (e.g. -1 for nobody) to one byte
+static void put_svarint(writer_t *w, int32_t v) {
+    put_uvarint(w, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+// tokens are random, a varint would only make them longer
+static void put_u64(writer_t *w, uint64_t v) {
+    for (int shift = 56; shift >= 0; shift -= 8) put_u8(w, (uint8_t)(v >> shift));
+}
+
+static void put_card(writer_t *w, card_t card) {
+    put_u8(w, card < 0 || card >= DECK_SIZE ? NO_CARD_BYTE : (uint8_t)card);
+}
+
+static void put_statuses(writer_t *w, const int *status) {
+    unsigned bits = 0;
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        bits |= (unsigned)(status[i] & ((1 << STATUS_BITS) - 1)) << (i * STATUS_BITS);
+    }
+    put_u8(w, bits & 0xff);
+    put_u8(w, bits >> 8);
+}
+
+static uint8_t *begin_frame(writer_t *w, uint8_t *out, int type) {
+    w->p = out + PROTO_LENGTH_SIZE;
+    put_u8(w, PROTO_VERSION);
+    put_u8(w, (uint8_t)type);
+    return out;
+}
+
+static size_t end_frame(writer_t *w, uint8_t *out) {
+    size_t body = w->p - out - PROTO_LENGTH_SIZE;
+    out[0] = body >> 8;
+    out[1] = body & 0xff;
+    return w->p - out;
+}
+
+// ---------------------------- reading ---------------------------- //
+
+static uint8_t get_u8(reader_t *r) {
+    if (r->p >= r->end) {
+        r->bad = 1;
+        return 0;
+    }
+    return *r->p++;
+}
+
+static uint32_t get_uvarint(reader_t *r) {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t b = get_u8(r);
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    r->bad = 1;
+    return 0;
+}
+
+static int32_t get_svarint(reader_t *r) {
+    uint32_t v = get_uvarint(r);
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static uint64_t get_u64(reader_t *r) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = v << 8 | get_u8(r);
+    return v;
+}
+
+static card_t get_card(reader_t *r) {
+    uint8_t b = get_u8(r);
+    if (b == NO_CARD_BYTE) return NOCARD;
+    if (b >= DECK_SIZE) r->bad = 1;
+    return b;
+}
+
+static void get_statuses(reader_t *r, int *status) {
+    unsigned bits = get_u8(r);
+    bits |= (unsigned)get_u8(r) << 8;
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        status[i] = (bits >> (i * STATUS_BITS)) & ((1 << STATUS_BITS) - 1);
+    }
+}
+
+int proto_frame_size(const uint8_t *buf, size_t len) {
+    if (len < PROTO_LENGTH_SIZE) return 0;
+    size_t size = PROTO_LENGTH_SIZE + ((size_t)buf[0] << 8 | buf[1]);
+    if (size < PROTO_HEADER_SIZE || size > PROTO_MAX_FRAME) return -1;
+    return (int)size;
+}
+
+int proto_frame_type(const uint8_t *buf, size_t len) {
+    return len < PROTO_HEADER_SIZE ? -1 : buf[PROTO_LENGTH_SIZE + 1];
+}
+
+// checks the header of a complete frame and sets r up to read its payload
+static int open_frame(const uint8_t *buf, size_t len, reader_t *r, int *type) {
+    int size = proto_frame_size(buf, len);
+    if (size <= 0 || (size_t)size > len) return size < 0 ? -1 : 0;
+    if (buf[PROTO_LENGTH_SIZE] != PROTO_VERSION) return -1;
+
+    *type = buf[PROTO_LENGTH_SIZE + 1];
+    r->p = buf + PROTO_HEADER_SIZE;
+    r->end = buf + size;
+    r->bad = 0;
+    return size;
+}
+
+// a frame must be read to its last byte, anything left over means a different layout
+static int close_frame(const reader_t *r, int size) {
+    return r->bad || r->p != r->end ? -1 : size;
+}
+
+// ---------------------------- client packets ---------------------------- //
+
+size_t proto_encode_client(const client_packet_t *pkt, uint8_t *out) {
+    writer_t w;
+    begin_frame(&w, out, pkt->packet_type);
+    switch (pkt->packet_type) {
+        case JOIN:
+            put_svarint(&w, pkt->params[0]);
+            put_svarint(&w, pkt->params[1]);
+            break;
+        case RAISE:
+            put_svarint(&w, pkt->params[0]);
+            break;
+        default:
+            break;
+    }
+    return end_frame(&w, out);
+}
+
+int proto_decode_client(const uint8_t *buf, size_t len, client_packet_t *pkt) {
+    reader_t r;
+    int type;
+    int size = open_frame(buf, len, &r, &type);
+    if (size <= 0) return size;
+    if (type > FOLD) return -1;
+
+    memset(pkt, 0, sizeof *pkt);
+    pkt->packet_type = type;
+    switch (pkt->packet_type) {
+        case JOIN:
+            pkt->params[0] = get_svarint(&r);
+            pkt->params[1] = get_svarint(&r);
+            break;
+        case RAISE:
+            pkt->params[0] = get_svarint(&r);
+            break;
+        default:
+            break;
+    }
+    return close_frame(&r, size);
+}
+
+size_t proto_encode_attach(const char *name, uint8_t *out) {
+    writer_t w;
+    begin_frame(&w, out, PROTO_ATTACH);
+    size_t len = strlen(name);
+    memcpy(w.p, name, len);
+    w.p += len;
+    return end_frame(&w, out);
+}
+
+int proto_decode_attach(const uint8_t *buf, size_t len, char *name, size_t cap) {
+    reader_t r;
+    int type;
+    int size = open_frame(buf, len, &r, &type);
+    if (size <= 0) return size;
+    if (type != PROTO_ATTACH) return -1;
+
+    // the name is the rest of the frame
+    size_t n = r.end - r.p;
+    if (n == 0 || n >= cap || memchr(r.p, '\0', n)) return -1;
+    memcpy(name, r.p, n);
+    name[n] = '\0';
+    return size;
+}
+
+size_t proto_encode_resume(int table_id, player_id_t seat, uint64_t token, uint8_t *out) {
+    writer_t w;
+    begin_frame(&w, out, PROTO_RESUME);
+    put_svarint(&w, table_id);
+    put_svarint(&w, seat);
+    put_u64(&w, token);
+    return end_frame(&w, out);
+}
+
+int proto_decode_resume(const uint8_t *buf, size_t len, int *table_id, player_id_t *seat, uint64_t *token) {
+    reader_t r;
+    int type;
+    int size = open_frame(buf, len, &r, &type);
+    if (size <= 0) return size;
+    if (type != PROTO_RESUME) return -1;
+
+    *table_id = get_svarint(&r);
+    *seat = get_svarint(&r);
+    *token = get_u64(&r);
+    return close_frame(&r, size);
+}
+
+size_t proto_encode_watch(int table_id, uint8_t *out) {
+    writer_t w;
+    begin_frame(&w, out, PROTO_WATCH);
+    put_svarint(&w, table_id);
+    return end_frame(&w, out);
+}
+
+int proto_decode_watch(const uint8_t *buf, size_t len, int *table_id) {
+    reader_t r;
+    int type;
+    int size = open_frame(buf, len, &r, &type);
+    if (size <= 0) return size;
+    if (type != PROTO_WATCH) return -1;
+
+    *table_id = get_svarint(&r);
+    return close_frame(&r, size);
+}
+
+// ---------------------------- server packets ---------------------------- //
+
+size_t proto_encode_seated(player_id_t seat, uint8_t *out) {
+    writer_t w;
+    begin_frame(&w, out, PROTO_SEATED);
+    put_svarint(&w, seat);
+    return end_frame(&w, out);
+}
+
+int proto_decode_seated(const uint8_t *buf, size_t len, player_id_t *seat) {
+    reader_t r;
+    int type;
+    int size = open_frame(buf, len, &r, &type);
+    if (size <= 0) return size;
+    if (type != PROTO_SEATED) return -1;
+
+    *seat = get_svarint(&r);
+    if (*seat < 0 || *seat >= MAX_PLAYERS) r.bad = 1;
+    return close_frame(&r, size);
+}
+
+size_t proto_encode_session(uint64_t token, uint8_t *out) {
+    writer_t w;
+    begin_frame(&w, out, PROTO_SESSION);
+    put_u64(&w, token);
+    return end_frame(&w, out);
+}
+
+int proto_decode_session(const uint8_t *buf, size_t len, uint64_t *token) {
+    reader_t r;
+    int type;
+    int size = open_frame(buf, len, &r, &type);
+    if (size <= 0) return size;
+    if (type != PROTO_SESSION) return -1;
+
+    *token = get_u64(&r);
+    return close_frame(&r, size);
+}
+
+// the fields every seat is sent alike, hole cards travel separately after them
+static void put_public(writer_t *w, const info_packet_t *info) {
+    for (int i = 0; i < 5; ++i) put_card(w, info->community_cards[i]);
+    for (int i = 0; i < MAX_PLAYERS; ++i) put_uvarint(w, info->player_stacks[i]);
+    put_uvarint(w, info->pot_size);
+    put_svarint(w, info->dealer);
+    put_svarint(w, info->player_turn);
+    put_uvarint(w, info->bet_size);
+    for (int i = 0; i < MAX_PLAYERS; ++i) put_uvarint(w, info->player_bets[i]);
+    put_statuses(w, info->player_status);
+}
+
+static void get_public(reader_t *r, info_packet_t *info) {
+    for (int i = 0; i < 5; ++i) info->community_cards[i] = get_card(r);
+    for (int i = 0; i < MAX_PLAYERS; ++i) info->player_stacks[i] = get_uvarint(r);
+    info->pot_size = get_uvarint(r);
+    info->dealer = get_svarint(r);
+    info->player_turn = get_svarint(r);
+    info->bet_size = get_uvarint(r);
+    for (int i = 0; i < MAX_PLAYERS; ++i) info->player_bets[i] = get_uvarint(r);
+    get_statuses(r, info->player_status);
+}
+
+static void put_info(writer_t *w, const info_packet_t *info) {
+    put_public(w, info);
+    put_card(w, info->player_cards[0]);
+    put_card(w, info->player_cards[1]);
+}
+
+static void get_info(reader_t *r, info_packet_t *info) {
+    get_public(r, info);
+    info->player_cards[0] = get_card(r);
+    info->player_cards[1] = get_card(r);
+}
+
+static void put_end(writer_t *w, const end_packet_t *end) {
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        put_card(w, end->player_cards[i][0]);
+        put_card(w, end->player_cards[i][1]);
+    }
+    for (int i = 0; i < 5; ++i) put_card(w, end->community_cards[i]);
+    for (int i = 0; i < MAX_PLAYERS; ++i) put_uvarint(w, end->player_stacks[i]);
+    put_uvarint(w, end->pot_size);
+    put_svarint(w, end->dealer);
+    put_svarint(w, end->winner);
+    put_statuses(w, end->player_status);
+
+    int num_pots = end->num_pots < 0 ? 0 : end->num_pots > MAX_POTS ? MAX_POTS : end->num_pots;
+    put_u8(w, num_pots);
+    for (int i = 0; i < num_pots; ++i) {
+        put_uvarint(w, end->pots[i].amount);
+        put_u8(w, end->pots[i].winners);
+    }
+}
+
+static void get_end(reader_t *r, end_packet_t *end) {
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        end->player_cards[i][0] = get_card(r);
+        end->player_cards[i][1] = get_card(r);
+    }
+    for (int i = 0; i < 5; ++i) end->community_cards[i] = get_card(r);
+    for (int i = 0; i < MAX_PLAYERS; ++i) end->player_stacks[i] = get_uvarint(r);
+    end->pot_size = get_uvarint(r);
+    end->dealer = get_svarint(r);
+    end->winner = get_svarint(r);
+    get_statuses(r, end->player_status);
+
+    end->num_pots = get_u8(r);
+    if (end->num_pots > MAX_POTS) {
+        r->bad = 1;
+        return;
+    }
+    for (int i = 0; i < end->num_pots; ++i) {
+        end->pots[i].amount = get_uvarint(r);
+        end->pots[i].winners = get_u8(r);
+    }
+}
+
+static unsigned public_changes(const info_packet_t *a, const info_packet_t *b) {
+    unsigned mask = 0;
+    if (memcmp(a->community_cards, b->community_cards, sizeof a->community_cards)) mask |= D_BOARD;
+    if (a->pot_size != b->pot_size) mask |= D_POT;
+    if (a->dealer != b->dealer) mask |= D_DEALER;
+    if (a->player_turn != b->player_turn) mask |= D_TURN;
+    if (a->bet_size != b->bet_size) mask |= D_BET;
+    if (memcmp(a->player_status, b->player_status, sizeof a->player_status)) mask |= D_STATUS;
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        if (a->player_stacks[i] != b->player_stacks[i]) mask |= D_STACK(i);
+        if (a->player_bets[i] != b->player_bets[i]) mask |= D_BETS(i);
+    }
+    return mask;
+}
+
+static void put_public_delta(writer_t *w, const info_packet_t *base, const info_packet_t *info) {
+    unsigned mask = public_changes(base, info);
+    put_uvarint(w, mask);
+    if (mask & D_BOARD) {
+        for (int i = 0; i < 5; ++i) put_card(w, info->community_cards[i]);
+    }
+    if (mask & D_POT) put_uvarint(w, info->pot_size);
+    if (mask & D_DEALER) put_svarint(w, info->dealer);
+    if (mask & D_TURN) put_svarint(w, info->player_turn);
+    if (mask & D_BET) put_uvarint(w, info->bet_size);
+    if (mask & D_STATUS) put_statuses(w, info->player_status);
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        if (mask & D_STACK(i)) put_uvarint(w, info->player_stacks[i]);
+        if (mask & D_BETS(i)) put_uvarint(w, info->player_bets[i]);
+    }
+}
+
+// a delta only carries hole cards when they changed, they are whatever follows the public fields
+static void get_info_delta(reader_t *r, const info_packet_t *base, info_packet_t *info) {
+    *info = *base;
+
+    unsigned mask = get_uvarint(r);
+    if (mask & ~D_ALL) {
+        r->bad = 1;
+        return;
+    }
+    if (mask & D_BOARD) {
+        for (int i = 0; i < 5; ++i) info->community_cards[i] = get_card(r);
+    }
+    if (mask & D_POT) info->pot_size = get_uvarint(r);
+    if (mask & D_DEALER) info->dealer = get_svarint(r);
+    if (mask & D_TURN) info->player_turn = get_svarint(r);
+    if (mask & D_BET) info->bet_size = get_uvarint(r);
+    if (mask & D_STATUS) get_statuses(r, info->player_status);
+    for (int i = 0; i < MAX_PLAYERS; ++i) {
+        if (mask & D_STACK(i)) info->player_stacks[i] = get_uvarint(r);
+        if (mask & D_BETS(i)) info->player_bets[i] = get_uvarint(r);
+    }
+    if (r->p < r->end) {
+        info->player_cards[0] = get_card(r);
+        info->player_cards[1] = get_card(r);
+    }
+}
+
+void proto_encode_info_public(const info_packet_t *base, const info_packet_t *info, proto_public_t *out) {
+    writer_t w = { .p = out->body };
+    if (base) {
+        out->type = PROTO_INFO_DELTA;
+        put_public_delta(&w, base, info);
+    } else {
+        out->type = INFO;
+        put_public(&w, info);
+    }
+    out->len = w.p - out->body;
+}
+
+int proto_info_frame(const proto_public_t *pub, const card_t *hole, uint8_t *scratch, struct iovec *iov) {
+    uint8_t *tail = scratch + PROTO_HEADER_SIZE;
+    writer_t w = { .p = tail };
+    // a full INFO always ends in the hole cards, a delta only when they changed
+    if (hole || pub->type == INFO) {
+        put_card(&w, hole ? hole[0] : NOCARD);
+        put_card(&w, hole ? hole[1] : NOCARD);
+    }
+    size_t tail_len = w.p - tail;
+
+    size_t body = 2 + pub->len + tail_len;
+    scratch[0] = body >> 8;
+    scratch[1] = body & 0xff;
+    scratch[2] = PROTO_VERSION;
+    scratch[3] = (uint8_t)pub->type;
+
+    int n = 0;
+    iov[n++] = (struct iovec){ .iov_base = scratch, .iov_len = PROTO_HEADER_SIZE };
+    iov[n++] = (struct iovec){ .iov_base = (void *)pub->body, .iov_len = pub->len };
+    if (tail_len) iov[n++] = (struct iovec){ .iov_base = tail, .iov_len = tail_len };
+    return n;
+}
+
+size_t proto_encode_server(const server_packet_t *pkt, uint8_t *out) {
+    writer_t w;
+    begin_frame(&w, out, pkt->packet_type);
+    switch (pkt->packet_type) {
+        case INFO:
+            put_info(&w, &pkt->info);
+            break;
+        case END:
+            put_end(&w, &pkt->end);
+            break;
+        default:
+            break;
+    }
+    return end_frame(&w, out);
+}
+
+int proto_decode_server(const uint8_t *buf, size_t len, const info_packet_t *base, server_packet_t *pkt) {
+    reader_t r;
+    int type;
+    int size = open_frame(buf, len, &r, &type);
+    if (size <= 0) return size;
+
+    memset(pkt, 0, sizeof *pkt);
+    if (type == PROTO_INFO_DELTA) {
+        // without the packet it is relative to, a delta cannot be applied
+        if (!base) return -1;
+        pkt->packet_type = INFO;
+        get_info_delta(&r, base, &pkt->info);
+        return close_frame(&r, size);
+    }
+    if (type > HALT) return -1;
+
+    pkt->packet_type = type;
+    switch (pkt->packet_type) {
+        case INFO:
+            get_info(&r, &pkt->info);
+            break;
+        case END:
+            get_end(&r, &pkt->end);
+            break;
+        default:
+            break;
+    }
+    return close_frame(&r, size);
+}
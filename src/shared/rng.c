@@ -0,0 +1,50 @@
+#include "rng.h"
+
+// splitmix64, used to spread a seed over the full generator state
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+void rng_init(rng_t *rng, uint64_t seed, uint64_t stream) {
+    uint64_t x = stream;
+    x = seed ^ splitmix64(&x);
+    for (int i = 0; i < 4; ++i) {
+        rng->s[i] = splitmix64(&x);
+    }
+}
+
+uint64_t rng_next(rng_t *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+uint32_t rng_below(rng_t *rng, uint32_t bound) {
+    // lemire's multiply and reject: only the low 2^32 % bound products are biased
+    uint64_t m = (uint64_t)(uint32_t)rng_next(rng) * bound;
+    uint32_t low = (uint32_t)m;
+    if (low < bound) {
+        uint32_t threshold = -bound % bound;
+        while (low < threshold) {
+            m = (uint64_t)(uint32_t)rng_next(rng) * bound;
+            low = (uint32_t)m;
+        }
+    }
+    return m >> 32;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_ring.h"
+
+#define RING_MASK (SHM_RING_SIZE - 1)
+
+shm_channel_t *shm_channel_create(char *name) {
+    static _Atomic unsigned counter;
+    snprintf(name, SHM_NAME_MAX, SHM_NAME_PREFIX "%ld.%u", (long)getpid(), atomic_fetch_add(&counter, 1));
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return NULL;
+    // a fresh segment reads as zeros, which is two empty rings with nobody parked
+    if (ftruncate(fd, sizeof(shm_channel_t)) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(shm_channel_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+    return p;
+}
+
+shm_channel_t *shm_channel_open(const char *name) {
+    struct stat st;
+
+    // a client must not get us to unlink anything but a channel
+    if (strncmp(name, SHM_NAME_PREFIX, strlen(SHM_NAME_PREFIX)) != 0 || strchr(name + 1, '/')) return NULL;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return NULL;
+    shm_unlink(name);
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size != sizeof(shm_channel_t)) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(shm_channel_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+void shm_channel_close(shm_channel_t *ch) {
+    munmap(ch, sizeof *ch);
+}
+
+size_t shm_ring_used(shm_ring_t *r) {
+    return atomic_load(&r->head) - atomic_load(&r->tail);
+}
+
+size_t shm_ring_write(shm_ring_t *r, const void *buf, size_t len) {
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t room = SHM_RING_SIZE - (head - atomic_load(&r->tail));
+    if (len > room) len = room;
+
+    size_t at = head & RING_MASK;
+    size_t first = SHM_RING_SIZE - at < len ? SHM_RING_SIZE - at : len;
+    memcpy(r->data + at, buf, first);
+    memcpy(r->data, (const uint8_t *)buf + first, len - first);
+    atomic_store(&r->head, head + (uint32_t)len);
+    return len;
+}
+
+size_t shm_ring_read(shm_ring_t *r, void *buf, size_t len) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t used = atomic_load(&r->head) - tail;
+    if (len > used) len = used;
+
+    size_t at = tail & RING_MASK;
+    size_t first = SHM_RING_SIZE - at < len ? SHM_RING_SIZE - at : len;
+    memcpy(buf, r->data + at, first);
+    memcpy((uint8_t *)buf + first, r->data, len - first);
+    atomic_store(&r->tail, tail + (uint32_t)len);
+    return len;
+}
+
+// parking sets the flag before looking at the ring again, and the other side
+// moves the index before looking at the flag. with both sequentially
+// consistent, at least one of them sees the other, so no wakeup is lost
+
+int shm_ring_park_reader(shm_ring_t *r) {
+    atomic_store(&r->reader_parked, 1);
+    if (shm_ring_used(r) == 0) return 1;
+    atomic_store(&r->reader_parked, 0);
+    return 0;
+}
+
+void shm_ring_unpark_reader(shm_ring_t *r) {
+    atomic_store(&r->reader_parked, 0);
+}
+
+int shm_ring_park_writer(shm_ring_t *r) {
+    atomic_store(&r->writer_parked, 1);
+    if (shm_ring_used(r) == SHM_RING_SIZE) return 1;
+    atomic_store(&r->writer_parked, 0);
+    return 0;
+}
+
+int shm_ring_reader_parked(shm_ring_t *r) {
+    return atomic_load(&r->reader_parked) && atomic_exchange(&r->reader_parked, 0);
+}
+
+int shm_ring_writer_parked(shm_ring_t *r) {
+    return atomic_load(&r->writer_parked) && atomic_exchange(&r->writer_parked, 0);
+}